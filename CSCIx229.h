@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <stddef.h>
 #include <math.h>
 #include <time.h> 
 
@@ -49,26 +50,250 @@
 #define Sin(th) sin(3.14159265/180*(th))
 
 
+//  Mesh vertex
+typedef struct
+{
+   float x,y,z;     //  Position
+   float nx,ny,nz;  //  Normal
+   float s,t;       //  Texture coordinates
+   float r,g,b,a;   //  Color
+} vtx_t;
+
+//  Indexed triangle mesh
+typedef struct
+{
+   int nv,mv;             //  Vertex count and capacity
+   vtx_t* v;              //  Vertexes
+   int ni,mi;             //  Index count and capacity
+   unsigned int* idx;     //  Triangle indexes
+   int mode,first;        //  Primitive being assembled and its first vertex
+   vtx_t cur;             //  Current normal, texture coordinate and color
+   int color;             //  Per vertex colors set (otherwise glColor is used)
+   unsigned int vbo,ibo;  //  Buffer objects (0 until uploaded)
+   int count;             //  Indexes in the buffer objects
+} mesh_t;
+
+//  Builds a mesh from shape parameters
+typedef void (*geobuild_t)(mesh_t* m,const double p[]);
+
+//  Hexagonal column faces
+#define HEX_TOP    1   //  Top cap
+#define HEX_BOTTOM 2   //  Bottom cap
+#define HEX_SIDE   4   //  First side, the side facing angle i+30 is HEX_SIDE<<(i/60)
+
+//  World space bounding box and sphere
+typedef struct
+{
+   float min[3],max[3];  //  Axis aligned box
+   float center[3];      //  Bounding sphere center
+   float radius;         //  Bounding sphere radius
+} bounds_t;
+
+//  View frustum planes (ax+by+cz+d>=0 inside)
+typedef struct
+{
+   float plane[6][4];
+} frustum_t;
+
+//  Draws a scene node
+typedef void (*scenedraw_t)(int arg);
+
+//  Advances a simulation state by dt seconds
+typedef void (*simstep_t)(void* state,double dt);
+
+//  Point light
+typedef struct
+{
+   float position[3];  //  World position
+   float radius;       //  Distance the light reaches
+   float color[4];     //  Color (alpha unused)
+} pointlight_t;
+
+//  Render queue passes
+#define RENDER_OPAQUE   0
+#define RENDER_ADDITIVE 1
+#define RENDER_OIT      2
+
+//  State for a render queue draw
+typedef struct
+{
+   int pass;      //  RENDER_OPAQUE, RENDER_ADDITIVE or RENDER_OIT
+   int program;   //  Shader program (0 for fixed function)
+   int texture;   //  2D texture (0 for none)
+   int material;  //  From RenderMaterial (0 to leave as is)
+   int dirty;     //  Draw changes texture or material itself
+} rstate_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 void Print(const char* format , ...);
+void PrintInit(void);
+void PrintFlush(void);
 void Fatal(const char* format , ...);
 unsigned int LoadTexBMP(const char* file);
+void BGRtoRGB(unsigned char* image,unsigned int size);
 void Project(double fov,double asp,double dim);
 void ErrCheck(const char* where);
 int  LoadOBJ(const char* file);
 void calcNormal(double ax, double ay, double az, 
                double bx, double by, double bz, 
                double cx, double cy, double cz);
+void calcNormalMesh(mesh_t* m,
+               double ax, double ay, double az,
+               double bx, double by, double bz,
+               double cx, double cy, double cz);
 void calcTextCord( double x, double y);
-void calcNormal2V(double X0, double Y0, double Z0, double X1, double Y1, double Z1);
+void hsvToRgb(double hsv[3], GLfloat rgb[3]);
 double rawnoise(int n);
 double noise3d(int x, int y, int z, int octave, int seed);
 double interpolate(double a, double b, double x);
 double smooth3d(double x, double y, double z, int octave, int seed);
 double pnoise3d(double x, double y, double z, double persistence, int octaves, int seed);
+int  ReadOBJMesh(const char* file,mesh_t* mesh);
+int  LoadOBJMesh(const char* file,mesh_t* mesh);
+void MeshInit(mesh_t* m);
+void MeshBegin(mesh_t* m,int mode);
+void MeshEnd(mesh_t* m);
+void MeshNormal(mesh_t* m,double nx,double ny,double nz);
+void MeshTexCoord(mesh_t* m,double s,double t);
+void MeshColor(mesh_t* m,double r,double g,double b,double a);
+void MeshVertex(mesh_t* m,double x,double y,double z);
+void MeshAppend(mesh_t* dst,const mesh_t* src,const float M[16],const float color[4]);
+void MeshUpload(mesh_t* m);
+void MeshBind(const mesh_t* m);
+void MeshUnbind(void);
+void MeshDraw(const mesh_t* m);
+void MeshFree(mesh_t* m);
+void MeshStats(int* ndraw);
+void InstanceInit(int prog);
+int  InstanceMesh(const mesh_t* mesh);
+void InstanceAdd(int id,const float M[16],const float color[4],const float emission[4]);
+void InstanceFlush(void);
+void InstanceFlushMesh(int id);
+void InstanceMode(int on);
+void InstanceStats(int* ndraw,int* ninst);
+void InstanceMatrix(float M[16],const float P[16],double x,double y,double z,double th,double s);
+void Sphere(mesh_t* m,const double p[]);
+void TubeGeometry(mesh_t* m,const double p[]);
+void CarGeometry(mesh_t* m,const double p[]);
+int  HexColumn(mesh_t* m,double x,double y,double z,double r,double h,int top,int hide);
+const mesh_t* GeoCache(geobuild_t build,int n,const double p[]);
+void GeoCacheBudget(int size);
+void GeoCacheStats(int* nhit,int* nmiss,int* nevict,int* nbytes);
+double Timer(void);
+void BoundsBox(bounds_t* b,double x0,double y0,double z0,double x1,double y1,double z1);
+void BoundsSphere(bounds_t* b,double x,double y,double z,double r);
+void BoundsTransform(bounds_t* out,const bounds_t* in,const float M[16]);
+void BoundsMesh(bounds_t* b,const mesh_t* m);
+void FrustumFromGL(frustum_t* f);
+int  FrustumTest(const frustum_t* f,const bounds_t* b);
+int  SceneAdd(const char* name,scenedraw_t draw,int arg,int parent,const bounds_t* bounds);
+void SceneMove(int id,const bounds_t* bounds);
+void SceneEnable(int id,int on);
+void SceneCull(const frustum_t* f);
+void SceneDraw(void);
+void SceneStats(int* ndrawn,int* nculled,double* seconds);
+void SceneOcclusion(int id,int on);
+void SceneOcclusionMode(int on);
+void SceneQuery(void);
+void SceneOcclusionStats(int* nskipped,int* nqueries,int* nwaiting,double* latency);
+int  RenderMaterial(const float specular[4],float shininess,const float emission[4]);
+void RenderBegin(void);
+void RenderSubmit(const rstate_t* s,double x,double y,double z,scenedraw_t draw,int arg);
+void RenderFlush(void);
+void RenderStats(int* ndraw,int* nchange,int* neliminated);
+double RenderTransparentTime(void);
+void RenderLighting(int on);
+void RenderMaterialFixed(int k);
+int  RenderDrawMaterial(void);
+void OITInit(int prog);
+void OITBegin(void);
+void OITEnd(void);
+void TraceStart(void);
+int  TraceOn(void);
+void TraceThread(const char* name);
+void TraceBegin(const char* name,const char* arg);
+void TraceEnd(void);
+int  TraceDump(const char* file);
+void ProfileMode(int enable);
+void ProfileFrame(void);
+void ProfileBegin(const char* name);
+void ProfileEnd(void);
+void ProfileDraw(void);
+void FrameBudget(double ms,double hitchms);
+void FrameBegin(void);
+void FrameReset(void);
+void FramePhase(const char* name);
+void FrameStats(double* p50,double* p90,double* p99,double* max,int* nover,int* nhitch);
+int  ShaderProgram(const char* vert,const char* frag,const char* defines);
+void ShaderStats(int* nprog,int* ncached,double* seconds);
+void PaceRate(double hz);
+void PaceWait(void);
+double PaceCPU(void);
+void SimInit(simstep_t step,const void* state,int size,double hz);
+void SimStart(void);
+void SimActive(int on);
+void SimRun(double t);
+double SimRead(void* prev,void* cur);
+void SimStats(int* nstep,double* mean,double* max,double* hz);
+#ifdef GLDEBUG
+void DebugInit(void);
+void DebugFrame(void);
+void DebugPush(const char* name);
+void DebugPop(void);
+void DebugLabel(unsigned int type,unsigned int id,const char* name);
+#else
+#define DebugInit()
+#define DebugFrame()
+#define DebugPush(name)
+#define DebugPop()
+#define DebugLabel(type,id,name)
+#endif
+void BenchContext(int width,int height);
+void BenchBegin(void);
+void BenchPhase(const char* name);
+void BenchEnd(void);
+void BenchReport(FILE* f);
+void StreamInit(int n);
+void StreamBegin(void);
+int  StreamWrite(const void* data,int n);
+unsigned int StreamBuffer(void);
+void StreamEnd(void);
+void StreamStats(int* nbytes,int* nstall,double* stall);
+void LightingInit(int shader);
+int  LightingProgram(void);
+void LightingMaterial(int k,const float specular[4],float shininess,const float emission[4]);
+void LightingMaterials(void);
+void LightingFrame(const float position[4],const float ambient[4],const float diffuse[4],
+                   const float specular[4],const float global[4]);
+void ClusterFrame(int prog,const pointlight_t* lights,int n);
+void ClusterStats(int* nlight,int* nref,int* nmax,int* ndrop,double* sec);
+void ShadowInit(int shader,int n);
+void ShadowInvalidate(void);
+void ShadowFrame(const float position[3],const float target[3],float fov,float znear,float zfar,
+                 float threshold,scenedraw_t statics,scenedraw_t dynamics);
+void ShadowOff(void);
+void ShadowStats(int* nrebuild,double* cpu,double* gpu);
+void SinCosDeg(int deg,float* s,float* c);
+float Vec3Dot(const float a[3],const float b[3]);
+void Vec3Cross(float r[3],const float a[3],const float b[3]);
+float Vec3Normalize(float v[3]);
+void Vec3NormalizeArray(float* v,int n);
+void Vec3CrossArray(float* r,const float* a,const float* b,int n);
+void Mat4Identity(float M[16]);
+void Mat4Multiply(float C[16],const float A[16],const float B[16]);
+void Mat4Transform(float r[4],const float M[16],const float v[4]);
+void Mat4Quat(float M[16],const float q[4]);
+void QuatAxis(float q[4],float th,float x,float y,float z);
+void QuatMultiply(float r[4],const float a[4],const float b[4]);
+void QuatRotate(float r[3],const float q[4],const float v[3]);
+int  XformAdd(int parent);
+void XformLocal(int id,const float M[16]);
+void XformUpdate(void);
+const float* XformWorld(int id);
+void XformStats(int* nnode,int* nupdate);
 
 
 #ifdef __cplusplus
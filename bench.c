@@ -0,0 +1,160 @@
+//  CSCIx229 library
+//  Offscreen benchmark context and frame timing
+#include "CSCIx229.h"
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+//
+//  BenchContext makes an EGL pbuffer context, so a benchmark runs with
+//  no window or display, on Mesa's software renderer if there is no GPU.
+//
+//  Each frame is bracketed by BenchBegin and BenchEnd, and BenchPhase
+//  starts a named phase inside it.  Phase boundaries call glFinish, so a
+//  phase's time includes the GPU work it issued and the phases add up to
+//  the frame.  Outside BenchBegin/BenchEnd the calls do nothing, so the
+//  interactive program can keep its phase marks.
+//
+//  BenchReport writes min, mean, p99 and max of the frame and phase
+//  times in milliseconds as JSON.
+//
+
+#define MAXPHASE 16  //  Maximum number of named phases
+
+static const char* phase[MAXPHASE];  //  Phase names in order of first use
+static int Nphase=0;                 //  Number of phases
+static int cur=-1;                   //  Phase in progress (-1 for none)
+static int active=0;                 //  Inside BenchBegin/BenchEnd
+static double t0,tp;                 //  Start of the frame and of the phase
+static double* times=NULL;           //  Frame then phase times of each frame
+static int N=0,Max=0;                //  Frames recorded and allocated
+
+//
+//  Create an offscreen context with a width by height default framebuffer
+//
+void BenchContext(int width,int height)
+{
+#ifdef __linux__
+   EGLint major,minor,n;
+   EGLDisplay dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+   //  With no display server fall back to Mesa's surfaceless platform
+   if (!eglInitialize(dpy,&major,&minor))
+   {
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+      dpy = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,EGL_DEFAULT_DISPLAY,NULL);
+      if (!eglInitialize(dpy,&major,&minor))
+#endif
+         Fatal("Cannot initialize EGL\n");
+   }
+   EGLint attrib[] = {EGL_SURFACE_TYPE,EGL_PBUFFER_BIT,EGL_RENDERABLE_TYPE,EGL_OPENGL_BIT,
+                      EGL_RED_SIZE,8,EGL_GREEN_SIZE,8,EGL_BLUE_SIZE,8,EGL_DEPTH_SIZE,24,EGL_NONE};
+   EGLConfig config;
+   if (!eglChooseConfig(dpy,attrib,&config,1,&n) || n<1) Fatal("No EGL pbuffer configuration\n");
+   EGLint size[] = {EGL_WIDTH,width,EGL_HEIGHT,height,EGL_NONE};
+   EGLSurface surf = eglCreatePbufferSurface(dpy,config,size);
+   if (surf==EGL_NO_SURFACE) Fatal("Cannot create %dx%d EGL pbuffer\n",width,height);
+   if (!eglBindAPI(EGL_OPENGL_API)) Fatal("EGL has no desktop OpenGL\n");
+   EGLContext ctx = eglCreateContext(dpy,config,EGL_NO_CONTEXT,NULL);
+   if (ctx==EGL_NO_CONTEXT || !eglMakeCurrent(dpy,surf,surf,ctx)) Fatal("Cannot create EGL context\n");
+#else
+   Fatal("Offscreen benchmarks need EGL\n");
+#endif
+}
+
+//
+//  Start timing a frame
+//
+void BenchBegin(void)
+{
+   if (N>=Max)
+   {
+      Max = Max ? 2*Max : 256;
+      times = (double*)realloc(times,Max*(MAXPHASE+1)*sizeof(double));
+      if (!times) Fatal("Cannot allocate %d benchmark frames\n",Max);
+   }
+   memset(times+N*(MAXPHASE+1),0,(MAXPHASE+1)*sizeof(double));
+   glFinish();
+   active = 1;
+   cur = -1;
+   t0 = tp = Timer();
+}
+
+//
+//  End the phase in progress and start the phase called name
+//    name must stay valid until BenchReport
+//
+void BenchPhase(const char* name)
+{
+   if (!active) return;
+   glFinish();
+   double t = Timer();
+   if (cur>=0) times[N*(MAXPHASE+1)+1+cur] += t-tp;
+   tp = t;
+   //  Find or add the phase
+   for (cur=0;cur<Nphase && strcmp(phase[cur],name);cur++);
+   if (cur==Nphase)
+   {
+      if (Nphase>=MAXPHASE) Fatal("Too many benchmark phases\n");
+      phase[Nphase++] = name;
+   }
+}
+
+//
+//  Finish the frame and record its times
+//
+void BenchEnd(void)
+{
+   if (!active) return;
+   glFinish();
+   double t = Timer();
+   if (cur>=0) times[N*(MAXPHASE+1)+1+cur] += t-tp;
+   times[N*(MAXPHASE+1)] = t-t0;
+   active = 0;
+   N++;
+}
+
+//
+//  Order doubles for qsort
+//
+static int Compare(const void* a,const void* b)
+{
+   double d = *(const double*)a - *(const double*)b;
+   return d<0 ? -1 : d>0;
+}
+
+//
+//  Write the statistics of column k as a JSON object
+//
+static void BenchStats(FILE* f,int k)
+{
+   double* v = (double*)malloc(N*sizeof(double));
+   if (!v) Fatal("Cannot allocate benchmark statistics\n");
+   double sum=0;
+   for (int i=0;i<N;i++)
+      sum += v[i] = 1000*times[i*(MAXPHASE+1)+k];
+   qsort(v,N,sizeof(double),Compare);
+   //  Nearest rank percentile
+   int p99 = (int)ceil(0.99*N)-1;
+   fprintf(f,"{\"min\": %.4f, \"mean\": %.4f, \"p99\": %.4f, \"max\": %.4f}",v[0],sum/N,v[p99],v[N-1]);
+   free(v);
+}
+
+//
+//  Write the recorded frames as JSON
+//
+void BenchReport(FILE* f)
+{
+   if (!N) Fatal("No benchmark frames recorded\n");
+   const char* renderer = (const char*)glGetString(GL_RENDERER);
+   fprintf(f,"{\n  \"frames\": %d,\n  \"renderer\": \"%s\",\n",N,renderer?renderer:"");
+   fprintf(f,"  \"frame_ms\": ");
+   BenchStats(f,0);
+   fprintf(f,",\n  \"phase_ms\": {");
+   for (int k=0;k<Nphase;k++)
+   {
+      fprintf(f,"%s\n    \"%s\": ",k?",":"",phase[k]);
+      BenchStats(f,k+1);
+   }
+   fprintf(f,"\n  }\n}\n");
+}
@@ -0,0 +1,308 @@
+//  CSCIx229 library
+//  Clustered forward point lights
+#include "CSCIx229.h"
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+//
+//  The view frustum is split into a grid of clusters: CX by CY tiles on
+//  the screen and CZ slices in depth, spaced exponentially between the
+//  near and far planes.  Every frame each light sphere is tested against
+//  the view space boxes of the clusters it can reach and the hits are
+//  sorted into one index list per cluster.  The lighting shader finds
+//  the cluster of a fragment from its window position and depth and
+//  only loops over that cluster's lights.
+//
+//  The cluster boxes are kept as structures of arrays so a row of four
+//  tiles is tested against a light with one set of SSE instructions.
+//
+//  Three float textures carry the result to the shader
+//    LightTex    MAXLIGHT by 2, view position and radius, then color
+//    ClusterTex  CX*CY by CZ, first index and light count
+//    IndexTex    IDXW wide, the light numbers of all clusters in order
+//  They are updated from the stream ring as a pixel unpack buffer, so the
+//  copies don't wait for frames still reading the previous contents.
+//
+
+#define CX 16            //  Tiles across (a multiple of 4)
+#define CY 9             //  Tiles down
+#define CZ 24            //  Depth slices
+#define NCLUSTER (CX*CY*CZ)
+#define MAXLIGHT 1024    //  Maximum number of lights
+#define IDXW     1024    //  Width of the index texture
+#define MAXREF   (256*IDXW)  //  Maximum number of cluster light references
+#define UNIT     4       //  First of three texture units used
+
+static float P0,P5,P8,P9;       //  Projection the boxes were built for
+static float znear,zfar;        //  Near and far distance
+static float xmin[CZ][CX],xmax[CZ][CX];  //  Tile x range in each slice
+static float ymin[CZ][CY],ymax[CZ][CY];  //  Tile y range in each slice
+static float dmin[CZ+1];                  //  Slice start distances
+static unsigned int tex[3];     //  Light, cluster and index textures
+static int idxh=0;              //  Rows allocated in the index texture
+static float light[2][MAXLIGHT][4];    //  Light texture data
+static float cluster[NCLUSTER][2];     //  Cluster texture data
+static int* ref=NULL;           //  Cluster and light of each hit
+static float* list=NULL;        //  Index texture data
+static int count[NCLUSTER+1];   //  Hits per cluster, then their offsets
+static int Nlight=0,Nref=0,Nmax=0,Ndrop=0;  //  Counts from the last frame
+static double seconds=0;        //  Time to assign the lights
+static int uprog=0;             //  Program the uniform locations are for
+static int locIndexSize,locViewport,locNear,locScale;  //  Its per frame uniforms
+
+//
+//  Rebuild the cluster boxes for projection P
+//    the box of a tile in a slice spans the tile's edges at both ends of
+//    the slice, since the frustum widens with depth
+//
+static void ClusterBoxes(const float P[16])
+{
+   P0 = P[0]; P5 = P[5]; P8 = P[8]; P9 = P[9];
+   znear = P[14]/(P[10]-1);
+   zfar  = P[14]/(P[10]+1);
+   for (int k=0;k<=CZ;k++)
+      dmin[k] = znear*pow(zfar/znear,(double)k/CZ);
+   for (int k=0;k<CZ;k++)
+   {
+      float d0=dmin[k],d1=dmin[k+1];
+      //  A view point at distance d and normalized device x has x = d*(ndc+P8)/P0
+      for (int i=0;i<CX;i++)
+      {
+         float a = -1+2.0*i/CX + P8;
+         float b = -1+2.0*(i+1)/CX + P8;
+         xmin[k][i] = fmin(a*d0,a*d1)/P0;
+         xmax[k][i] = fmax(b*d0,b*d1)/P0;
+      }
+      for (int j=0;j<CY;j++)
+      {
+         float a = -1+2.0*j/CY + P9;
+         float b = -1+2.0*(j+1)/CY + P9;
+         ymin[k][j] = fmin(a*d0,a*d1)/P5;
+         ymax[k][j] = fmax(b*d0,b*d1)/P5;
+      }
+   }
+}
+
+//
+//  Record the tiles of row j in slice k touched by a sphere
+//    c is the view space center, r2 the squared radius and
+//    d2 the squared distance from the center to the row in y and depth
+//
+static void ClusterRow(int k,int j,int l,const float c[3],float r2,float d2)
+{
+   int base = (k*CY+j)*CX;
+#ifdef __SSE__
+   __m128 cx = _mm_set1_ps(c[0]);
+   __m128 lim = _mm_set1_ps(r2-d2);
+   __m128 zero = _mm_setzero_ps();
+   for (int i=0;i<CX;i+=4)
+   {
+      //  Distance from the center to each box in x
+      __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(xmin[k]+i),cx),
+                                        _mm_sub_ps(cx,_mm_loadu_ps(xmax[k]+i))),zero);
+      int hit = _mm_movemask_ps(_mm_cmple_ps(_mm_mul_ps(dx,dx),lim));
+      for (int b=0;hit;b++,hit>>=1)
+         if ((hit&1) && Nref<MAXREF)
+         {
+            ref[2*Nref]   = base+i+b;
+            ref[2*Nref+1] = l;
+            Nref++;
+         }
+         else if (hit&1)
+            Ndrop++;
+   }
+#else
+   for (int i=0;i<CX;i++)
+   {
+      float dx = fmax(fmax(xmin[k][i]-c[0],c[0]-xmax[k][i]),0);
+      if (dx*dx > r2-d2)
+         continue;
+      else if (Nref<MAXREF)
+      {
+         ref[2*Nref]   = base+i;
+         ref[2*Nref+1] = l;
+         Nref++;
+      }
+      else
+         Ndrop++;
+   }
+#endif
+}
+
+//
+//  Test one light against the clusters in its depth range
+//
+static void ClusterLight(int l,const float c[3],float r)
+{
+   float d = -c[2];
+   float r2 = r*r;
+   if (d+r<znear || d-r>zfar) return;
+   //  Slices the sphere reaches
+   float s = CZ/log(zfar/znear);
+   int k0 = d-r>znear ? (int)(log((d-r)/znear)*s) : 0;
+   int k1 = (int)(log((d+r)/znear)*s);
+   if (k1>CZ-1) k1 = CZ-1;
+   for (int k=k0;k<=k1;k++)
+   {
+      float dz = fmax(fmax(dmin[k]-d,d-dmin[k+1]),0);
+      for (int j=0;j<CY;j++)
+      {
+         float dy = fmax(fmax(ymin[k][j]-c[1],c[1]-ymax[k][j]),0);
+         float d2 = dy*dy+dz*dz;
+         if (d2<=r2) ClusterRow(k,j,l,c,r2,d2);
+      }
+   }
+}
+
+//
+//  Set a texture to nearest sampling
+//
+static void ClusterTexture(unsigned int t)
+{
+   glBindTexture(GL_TEXTURE_2D,t);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+}
+
+//
+//  Look up the uniforms of the lighting shader prog and set the ones that
+//  never change, once per program
+//
+static void ClusterUniforms(int prog)
+{
+   uprog = prog;
+   locIndexSize = glGetUniformLocation(prog,"IndexSize");
+   locViewport  = glGetUniformLocation(prog,"ClusterViewport");
+   locNear      = glGetUniformLocation(prog,"ClusterNear");
+   locScale     = glGetUniformLocation(prog,"ClusterScale");
+   glUniform1i(glGetUniformLocation(prog,"LightTex"),UNIT);
+   glUniform1i(glGetUniformLocation(prog,"ClusterTex"),UNIT+1);
+   glUniform1i(glGetUniformLocation(prog,"IndexTex"),UNIT+2);
+   glUniform1f(glGetUniformLocation(prog,"LightWidth"),MAXLIGHT);
+   glUniform3f(glGetUniformLocation(prog,"ClusterSize"),CX,CY,CZ);
+}
+
+//
+//  Assign lights to clusters and hand them to the lighting shader
+//    call with the view matrix as the modelview
+//    light positions are in world coordinates
+//    an orthogonal projection has no clusters, so it gets no point lights
+//
+void ClusterFrame(int prog,const pointlight_t* lights,int n)
+{
+   double t0 = Timer();
+   float P[16],V[16];
+   glGetFloatv(GL_PROJECTION_MATRIX,P);
+   glGetFloatv(GL_MODELVIEW_MATRIX,V);
+   if (n>MAXLIGHT) n = MAXLIGHT;
+   if (P[15]!=0) n = 0;
+   else if (P[0]!=P0 || P[5]!=P5 || P[8]!=P8 || P[9]!=P9 || P[14]/(P[10]-1)!=znear)
+      ClusterBoxes(P);
+   if (!ref)
+   {
+      ref = (int*)malloc(2*MAXREF*sizeof(int));
+      list = (float*)malloc(MAXREF*sizeof(float));
+      if (!ref || !list) Fatal("Cannot allocate cluster light lists\n");
+   }
+
+   //  Test the lights in view coordinates
+   Nref = Ndrop = 0;
+   for (int l=0;l<n;l++)
+   {
+      const pointlight_t* p = lights+l;
+      float c[3];
+      for (int i=0;i<3;i++)
+         c[i] = V[i]*p->position[0] + V[4+i]*p->position[1] + V[8+i]*p->position[2] + V[12+i];
+      memcpy(light[0][l],c,sizeof(c));
+      light[0][l][3] = p->radius;
+      memcpy(light[1][l],p->color,sizeof(p->color));
+      ClusterLight(l,c,p->radius);
+   }
+
+   //  Counting sort of the hits by cluster
+   memset(count,0,sizeof(count));
+   for (int k=0;k<Nref;k++)
+      count[ref[2*k]+1]++;
+   Nmax = 0;
+   for (int k=0;k<NCLUSTER;k++)
+   {
+      if (count[k+1]>Nmax) Nmax = count[k+1];
+      cluster[k][0] = count[k];
+      cluster[k][1] = count[k+1];
+      count[k+1] += count[k];
+   }
+   for (int k=0;k<Nref;k++)
+      list[count[ref[2*k]]++] = ref[2*k+1];
+   Nlight = n;
+   seconds = Timer()-t0;
+
+   //  Upload through the stream ring
+   int rows = Nref ? (Nref+IDXW-1)/IDXW : 1;
+   glActiveTexture(GL_TEXTURE0+UNIT);
+   if (!tex[0])
+   {
+      glGenTextures(3,tex);
+      ClusterTexture(tex[0]);
+      glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,MAXLIGHT,2,0,GL_RGBA,GL_FLOAT,NULL);
+      ClusterTexture(tex[1]);
+      glTexImage2D(GL_TEXTURE_2D,0,GL_RG32F,CX*CY,CZ,0,GL_RG,GL_FLOAT,NULL);
+      ClusterTexture(tex[2]);
+   }
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER,StreamBuffer());
+   glBindTexture(GL_TEXTURE_2D,tex[0]);
+   if (n)
+   {
+      size_t pos = StreamWrite(light[0],n*sizeof(light[0][0]));
+      size_t col = StreamWrite(light[1],n*sizeof(light[1][0]));
+      glTexSubImage2D(GL_TEXTURE_2D,0,0,0,n,1,GL_RGBA,GL_FLOAT,(void*)pos);
+      glTexSubImage2D(GL_TEXTURE_2D,0,0,1,n,1,GL_RGBA,GL_FLOAT,(void*)col);
+   }
+   glActiveTexture(GL_TEXTURE0+UNIT+1);
+   glBindTexture(GL_TEXTURE_2D,tex[1]);
+   size_t off = StreamWrite(cluster,sizeof(cluster));
+   glTexSubImage2D(GL_TEXTURE_2D,0,0,0,CX*CY,CZ,GL_RG,GL_FLOAT,(void*)off);
+   glActiveTexture(GL_TEXTURE0+UNIT+2);
+   glBindTexture(GL_TEXTURE_2D,tex[2]);
+   //  Grow the index texture, which only needs the rows in use
+   if (rows>idxh)
+   {
+      idxh = rows;
+      glTexImage2D(GL_TEXTURE_2D,0,GL_R32F,IDXW,idxh,0,GL_RED,GL_FLOAT,NULL);
+   }
+   if (Nref)
+   {
+      //  Pad the last row so whole rows can be sent
+      memset(list+Nref,0,(rows*IDXW-Nref)*sizeof(float));
+      off = StreamWrite(list,rows*IDXW*sizeof(float));
+      glTexSubImage2D(GL_TEXTURE_2D,0,0,0,IDXW,rows,GL_RED,GL_FLOAT,(void*)off);
+   }
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+   glActiveTexture(GL_TEXTURE0);
+
+   //  Shader uniforms
+   int vp[4],cur;
+   glGetIntegerv(GL_VIEWPORT,vp);
+   glGetIntegerv(GL_CURRENT_PROGRAM,&cur);
+   glUseProgram(prog);
+   if (prog!=uprog) ClusterUniforms(prog);
+   glUniform2f(locIndexSize,IDXW,idxh);
+   glUniform4f(locViewport,vp[0],vp[1],vp[2],vp[3]);
+   glUniform1f(locNear,znear);
+   glUniform1f(locScale,n ? CZ/log(zfar/znear) : -1);
+   glUseProgram(cur);
+}
+
+//
+//  Return lights, cluster light references, most lights in one cluster,
+//  references dropped for lack of room and the assignment time of the
+//  last ClusterFrame
+//
+void ClusterStats(int* nlight,int* nref,int* nmax,int* ndrop,double* sec)
+{
+   *nlight = Nlight;
+   *nref   = Nref;
+   *nmax   = Nmax;
+   *ndrop  = Ndrop;
+   *sec    = seconds;
+}
@@ -0,0 +1,69 @@
+/*
+ *  Scene culling benchmark
+ *  Times SceneCull over the 10k ball stress field hierarchy of final.c
+ *  (a root group, 100 row groups and 100 balls a row) from a few views
+ *
+ *  make cullbench && ./cullbench
+ */
+#include "CSCIx229.h"
+
+#define ROWS  100   //  Rows of the stress field and balls a row
+#define PASSES 2000 //  Culls timed per view
+
+/*
+ *  Balls are counted but never drawn
+ */
+static void Ball(int k){
+}
+
+/*
+ *  The stress field as final.c builds it
+ */
+static void StressField(void){
+   bounds_t b;
+   int n = ROWS;
+   double x0 = (-n/2)*0.3-0.1, x1 = (n-1-n/2)*0.3+0.1;
+   BoundsBox(&b, x0, 6-0.1, x0, x1, 6+0.1, x1);
+   int root = SceneAdd("stress", NULL, 0, -1, &b);
+   for (int i = 0; i < n; i++){
+      double x = (i-n/2)*0.3;
+      BoundsBox(&b, x-0.1, 6-0.1, x0, x+0.1, 6+0.1, x1);
+      int row = SceneAdd("stress row", NULL, 0, root, &b);
+      for (int j = 0; j < n; j++){
+         BoundsSphere(&b, x, 6, (j-n/2)*0.3, 0.1);
+         SceneAdd("stress ball", Ball, n*i+j, row, &b);
+      }
+   }
+}
+
+/*
+ *  Time culling from the final.c camera at azimuth th and elevation ph
+ */
+static void View(const char* name, double th, double ph){
+   double dim = 5;
+   Project(55, 1.5, dim);
+   gluLookAt(-2*dim*Sin(th)*Cos(ph), +2*dim*Sin(ph), +2*dim*Cos(th)*Cos(ph), 0,0,0, 0,Cos(ph),0);
+   frustum_t f;
+   FrustumFromGL(&f);
+   for (int k = 0; k < 100; k++)
+      SceneCull(&f);
+   double t = Timer();
+   for (int k = 0; k < PASSES; k++)
+      SceneCull(&f);
+   t = Timer()-t;
+   int drawn, culled;
+   double seconds;
+   SceneStats(&drawn, &culled, &seconds);
+   printf("%-12s %8.4f ms per cull  drawn %5d  culled %5d\n", name, 1000*t/PASSES, drawn, culled);
+}
+
+int main(){
+   //  The frustum is taken from the GL matrices
+   BenchContext(16, 16);
+   StressField();
+   printf("%d balls in %d rows\n", ROWS*ROWS, ROWS);
+   View("default", 0, 0);
+   View("looking up", 0, -60);
+   View("from above", 0, 80);
+   return 0;
+}
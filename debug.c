@@ -0,0 +1,202 @@
+//  CSCIx229 library
+//  Asynchronous OpenGL error and performance reporting
+#include "CSCIx229.h"
+
+//
+//  Built only with -DGLDEBUG (make DEBUG=1); otherwise the Debug calls
+//  are empty macros and the program never asks the driver for errors
+//  while it runs.
+//
+//  DebugInit registers a KHR_debug (or ARB_debug_output) callback, so
+//  the driver reports errors and performance warnings as they happen
+//  instead of being polled with glGetError, which stalls on many
+//  drivers.  Output is synchronous, so the callback runs inside the GL
+//  call that raised the message and the open debug group is the one it
+//  belongs to.  The callback only copies the message into a queue, and
+//  DebugFrame prints the queue once a frame with that group.
+//  DebugPush/DebugPop name those groups after the draw functions, and
+//  DebugLabel names objects for the driver and for frame debuggers.
+//
+//  Without either extension DebugFrame falls back to ErrCheck.
+//
+
+#ifdef GLDEBUG
+#include <stdatomic.h>
+
+#define MAXMSG   256  //  Messages queued between frames
+#define MSGLEN   256  //  Longest message kept
+#define MAXGROUP 32   //  Deepest debug group nesting
+#define MAXID    256  //  Message ids tracked for repeats
+#define REPEAT   3    //  Reports of one message id before it is muted
+
+typedef struct
+{
+   GLenum source,type,severity;
+   GLuint id;
+   const char* group;  //  Innermost debug group when it arrived
+   char text[MSGLEN];  //  Message
+} msg_t;
+
+static int mode=0;                       //  0 none, 1 KHR_debug, 2 ARB_debug_output
+static msg_t queue[MAXMSG];              //  Messages since the last DebugFrame
+static int Nqueue=0;
+static int dropped=0;                    //  Messages lost to a full queue
+static atomic_flag lock=ATOMIC_FLAG_INIT;
+static const char* group[MAXGROUP];      //  Open debug groups
+static int depth=0;
+static GLuint seenId[MAXID];             //  Message ids reported so far
+static int seenCount[MAXID],Nseen=0;
+
+//
+//  Queue a message from the driver
+//
+static void APIENTRY DebugCallback(GLenum source,GLenum type,GLuint id,GLenum severity,
+                                   GLsizei length,const GLchar* message,const void* user)
+{
+   while (atomic_flag_test_and_set_explicit(&lock,memory_order_acquire));
+   if (Nqueue<MAXMSG)
+   {
+      msg_t* m = queue+Nqueue++;
+      m->source = source;
+      m->type = type;
+      m->severity = severity;
+      m->id = id;
+      m->group = depth>0 && depth<=MAXGROUP ? group[depth-1] : NULL;
+      snprintf(m->text,MSGLEN,"%s",message);
+   }
+   else
+      dropped++;
+   atomic_flag_clear_explicit(&lock,memory_order_release);
+}
+
+//
+//  Return whether extension name is supported
+//
+static int DebugExtension(const char* name)
+{
+   int n;
+   glGetIntegerv(GL_NUM_EXTENSIONS,&n);
+   for (int k=0;k<n;k++)
+      if (!strcmp((const char*)glGetStringi(GL_EXTENSIONS,k),name)) return 1;
+   return 0;
+}
+
+//
+//  Start reporting through the debug callback
+//
+void DebugInit(void)
+{
+   int major=0,minor=0;
+   glGetIntegerv(GL_MAJOR_VERSION,&major);
+   glGetIntegerv(GL_MINOR_VERSION,&minor);
+   if (major>4 || (major==4 && minor>=3) || DebugExtension("GL_KHR_debug"))
+   {
+      glEnable(GL_DEBUG_OUTPUT);
+      glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+      glDebugMessageCallback(DebugCallback,NULL);
+      //  Everything but notifications, which include the group markers
+      glDebugMessageControl(GL_DONT_CARE,GL_DONT_CARE,GL_DONT_CARE,0,NULL,GL_TRUE);
+      glDebugMessageControl(GL_DONT_CARE,GL_DONT_CARE,GL_DEBUG_SEVERITY_NOTIFICATION,0,NULL,GL_FALSE);
+      mode = 1;
+   }
+   else if (DebugExtension("GL_ARB_debug_output"))
+   {
+      glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS_ARB);
+      glDebugMessageCallbackARB(DebugCallback,NULL);
+      glDebugMessageControlARB(GL_DONT_CARE,GL_DONT_CARE,GL_DONT_CARE,0,NULL,GL_TRUE);
+      mode = 2;
+   }
+   fprintf(stderr,"GL debug output: %s\n",mode==1?"KHR_debug":mode==2?"ARB_debug_output":"glGetError");
+}
+
+//
+//  Name of a message source, type or severity
+//
+static const char* DebugName(GLenum e)
+{
+   switch (e)
+   {
+      case GL_DEBUG_SOURCE_API:                 return "api";
+      case GL_DEBUG_SOURCE_WINDOW_SYSTEM:       return "window";
+      case GL_DEBUG_SOURCE_SHADER_COMPILER:     return "compiler";
+      case GL_DEBUG_SOURCE_THIRD_PARTY:         return "third party";
+      case GL_DEBUG_SOURCE_APPLICATION:         return "application";
+      case GL_DEBUG_TYPE_ERROR:                 return "error";
+      case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:   return "deprecated";
+      case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:    return "undefined";
+      case GL_DEBUG_TYPE_PORTABILITY:           return "portability";
+      case GL_DEBUG_TYPE_PERFORMANCE:           return "performance";
+      case GL_DEBUG_SEVERITY_HIGH:              return "high";
+      case GL_DEBUG_SEVERITY_MEDIUM:            return "medium";
+      case GL_DEBUG_SEVERITY_LOW:               return "low";
+      default:                                  return "other";
+   }
+}
+
+//
+//  Report the messages queued since the last frame
+//    each message id is reported REPEAT times, then muted
+//
+void DebugFrame(void)
+{
+   if (!mode)
+   {
+      ErrCheck("frame");
+      return;
+   }
+   //  Take the queue so the callback is not held up while printing
+   static msg_t copy[MAXMSG];
+   while (atomic_flag_test_and_set_explicit(&lock,memory_order_acquire));
+   int n = Nqueue;
+   int lost = dropped;
+   memcpy(copy,queue,n*sizeof(msg_t));
+   Nqueue = dropped = 0;
+   atomic_flag_clear_explicit(&lock,memory_order_release);
+
+   for (int i=0;i<n;i++)
+   {
+      msg_t* m = copy+i;
+      int k;
+      for (k=0;k<Nseen && seenId[k]!=m->id;k++);
+      if (k==Nseen && Nseen<MAXID)
+      {
+         seenId[Nseen] = m->id;
+         seenCount[Nseen++] = 0;
+      }
+      int count = k<Nseen ? ++seenCount[k] : 1;
+      if (count>REPEAT) continue;
+      fprintf(stderr,"GL %s %s (%s) [%s]: %s%s\n",DebugName(m->type),DebugName(m->severity),DebugName(m->source),
+              m->group?m->group:"-",m->text,count==REPEAT?" (muted)":"");
+   }
+   if (lost) fprintf(stderr,"GL debug queue full, %d messages dropped\n",lost);
+}
+
+//
+//  Open a debug group called name
+//    name must stay valid while the group is open
+//
+void DebugPush(const char* name)
+{
+   if (depth<MAXGROUP) group[depth] = name;
+   depth++;
+   if (mode==1) glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION,0,-1,name);
+}
+
+//
+//  Close the innermost debug group
+//
+void DebugPop(void)
+{
+   if (!depth) return;
+   depth--;
+   if (mode==1) glPopDebugGroup();
+}
+
+//
+//  Name object id of type (GL_TEXTURE, GL_PROGRAM, GL_BUFFER ...)
+//
+void DebugLabel(unsigned int type,unsigned int id,const char* name)
+{
+   if (mode==1) glObjectLabel(type,id,-1,name);
+}
+#endif
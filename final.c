@@ -19,10 +19,11 @@
   F1         Toggle smooth/flat shading
  */
 #include "CSCIx229.h"
+#include <stdatomic.h>
 
 int axes=1;       //  Display axes
 int mode=1;       //  replace = 1, modulate = 0
-int move=1;       //  Move light
+atomic_int move=1; //  Move light
 int th=0;         //  Azimuth of view angle
 int ph=0;         //  Elevation of view angle
 int fov=55;       //  Field of view (for perspective)
@@ -39,7 +40,7 @@ int diffuse   =  100;  // Diffuse intensity (%)
 int specular  =   10;  // Specular intensity (%)
 int shininess =   0;  // Shininess (power of two)
 float shiny   =   1;  // Shininess (value)
-int zh        =  90;  // Light azimuth
+double zh     =  90;  // Light azimuth
 float ylight  =   2;  // Elevation of light
 
 int ntex = 1; // texture switch
@@ -50,15 +51,22 @@ char* textureName[] = {"Car.bmp","daylight.bmp","fence.bmp", "furniturebits_text
 
 int skyTexture;
 
-// to count fps
-static GLfloat fps = -1;
-static GLint T0 = 0;
-static GLint T1 = 0;
-static GLint Frames = 0;
+// benchmark mode, frames rendered offscreen on a fixed clock
+static int bench = 0;
+static int benchFrame = 0;
+// timeline written by the J key
+static const char* traceFile = "trace.json";
+#define BENCH_HZ 60
+// frame rate the animation is paced to (0 unpaced)
+static int fpsTarget = 60;
 // variables for the ball animation
 float bally = 2;
 float ballx = 2;
-float ballt = 0;
+// the simulation steps this many times a second
+#define SIM_HZ 120
+// ball resets asked for by the r key and seen in the last frame's state
+static atomic_int ballResets = 0;
+static int resetsSeen = 0;
 // load models
 char* ModelNames[] = {"cactus_medium_A.obj", "Rock_1.obj", "Rock_2.obj", "RockPlatforms_2.obj"};
 int myModels[4];
@@ -74,73 +82,94 @@ typedef struct
 Rock rockPosition[4];
 
 int myShader;
-/*
- *  Draw vertex in polar coordinates with normal, for Ball()
- */
-static void Vertex(double th,double ph)
-{
-   double x = Sin(th)*Cos(ph);
-   double y = Cos(th)*Cos(ph);
-   double z =         Sin(ph);
-   //  For a sphere at the origin, the position
-   //  and normal vectors are the same
-   glNormal3d(x,y,z);
-   glVertex3d(x,y,z);
-}
 
-/*
- *  Convert hsv color to rgb
- */
-void hsvToRgb(double hsv[3], GLfloat rgb[3]) {
-    double c, x, m;
-    double h = hsv[0], s = hsv[1], v = hsv[2];
-
-    c = v * s;
-    x = c * (1 - fabs(fmod(h / 60.0, 2) - 1));
-    m = v - c;
-
-    if (h >= 0 && h < 60) {
-        rgb[0] = c;
-        rgb[1] = x;
-        rgb[2] = 0;
-    } else if (h >= 60 && h < 120) {
-        rgb[0] = x;
-        rgb[1] = c;
-        rgb[2] = 0;
-    } else if (h >= 120 && h < 180) {
-        rgb[0] = 0;
-        rgb[1] = c;
-        rgb[2] = x;
-    } else if (h >= 180 && h < 240) {
-        rgb[0] = 0;
-        rgb[1] = x;
-        rgb[2] = c;
-    } else if (h >= 240 && h < 300) {
-        rgb[0] = x;
-        rgb[1] = 0;
-        rgb[2] = c;
-    } else {
-        rgb[0] = c;
-        rgb[1] = 0;
-        rgb[2] = x;
-    }
-
-    rgb[0] += m;
-    rgb[1] += m;
-    rgb[2] += m;
-}
+// instanced meshes
+int instancing = 1;   // glDrawElementsInstanced on / off
+int stress     = 0;   // draw the 10k ball stress field
+mesh_t islandMesh;    // merged island columns
+mesh_t cactusMesh;    // cactus for the static batch
+
+// static scene batching
+int batching   = 1;   // draw the static scene from the baked batch
+int staticDirty = 1;  // static set changed, bake again
+int listDraws  = 0;   // display list and immediate draws this frame
+int sceneDraws = 0;   // draw calls in the last frame
+typedef struct
+{
+   mesh_t mesh;        // merged geometry in world coordinates
+   int texture;        // texture (0 for none)
+   float specular;     // specular level
+   float shininess;    // shininess
+   float emission[4];  // emission
+   int transparent;    // additive blending without depth writes
+   float center[3];    // center of the bounds
+} static_t;
+#define STATIC_OPAQUE   0
+#define STATIC_EMISSIVE 1
+#define STATIC_CACTUS   2
+#define STATIC_SKY      3
+#define STATIC_TUBE     4
+#define NSTATIC         5
+static_t staticBatch[NSTATIC];
+mesh_t ballMesh;      // unit ball
+mesh_t rockMesh[4];   // rocks by style
+int ballInstance;
+int rockInstance[4];
+int instanceDraws = 0;
+int instanceCount = 0;
+
+// sphere levels of detail, coarse to fine
+#define NLOD 6
+const int lodInc[NLOD] = {45, 30, 18, 10, 6, 4};
+// projected radius in pixels that moves a sphere past each level
+const double lodPixels[NLOD-1] = {3, 8, 20, 50, 120};
+#define LOD_HYSTERESIS 0.15
+int lod = 1;                 // select sphere LOD by screen size
+mesh_t sphereLod[NLOD];
+int sphereLodInstance[NLOD];
+int lightLod = 0;            // current LOD of the light marker
+int ballLod = 0;             // current LOD of the ball
+unsigned char stressLod[10000];
+static int stressList[10000]; // stress balls found visible this frame
+static int stressVisible = 0; // number of them
+int sphereTriangles = 0;     // sphere triangles drawn this frame
+int sphereFixed = 0;         // same spheres at the fixed inc
+int islandFaces = 0;         // island faces before hidden faces are culled
+int islandKept = 0;          // and after
+int staticObjects = 0;       // objects merged into the static batches
+int staticTriangles = 0;     // their triangles
+double eye[3];               // eye position
+int viewHeight = 400;        // viewport height in pixels
+
+// scene graph
+int culling = 1;             // cull scene nodes against the view frustum
+int occlusion = 1;           // skip nodes whose bounds were hidden last frame
+int oit = 1;                 // weighted blended transparency, otherwise additive
+int oitShader;               // accumulation shader for the transparent pass
+int glsl = 1;                // per pixel lighting shader, otherwise fixed function
+#define MAXPOINT 1024
+pointlight_t pointLight[MAXPOINT];  // car balls, balloon and lanterns
+int pointLights = 4;         // point lights lit (GLSL lighting only)
+int lanternNode;             // lantern markers
+int shadows = 1;             // shadow map for light 0 (GLSL lighting only)
+int profile = 0;             // CPU and GPU scope timing chart
+int carXform, carBall[2];    // car and its emissive balls in the transform hierarchy
+float lightPosition[4];      // light position this frame
+int lightNode, ballNode;     // moving nodes
+int batchNode[NSTATIC];      // static batches, drawn when batching
+int objectNode[16];          // the same objects one by one, drawn when not batching
+int objectNodes = 0;
+int stressNode;              // root of the stress field
+bounds_t cactusBounds;       // OBJ model bounds from load time
+bounds_t rockBounds[4];
 
 /*
  *  Draw the hot air balloon
+ *     with a white specular material of shininess 1
  */
 static void hotAirBalloon(double x, double y, double z, double r)
 {
-   float white[]  = {1.0,1.0,1.0,1.0};
-   float Emission[] = {0.0,0.0,0.0,1.0};
-   glMaterialfv(GL_FRONT,GL_EMISSION,Emission);
-   glMaterialfv(GL_FRONT_AND_BACK,GL_SPECULAR,white);
-   glMaterialf(GL_FRONT_AND_BACK,GL_SHININESS,1);
-
+   ProfileBegin("hotAirBalloon");
    //  Save transformation
    glPushMatrix();
    glTranslated(x,y,z);
@@ -158,46 +187,60 @@ static void hotAirBalloon(double x, double y, double z, double r)
          float localR = 1+r* 1/cosh(2.75*(th*M_PI/180 + M_PI_2));
          float higherR = 1+r* 1/cosh(2.75*((th+5)*M_PI/180 + M_PI_2));
          float highestR = 1+r* 1/cosh(2.75*((th+10)*M_PI/180 + M_PI_2));
-         GLdouble localX = localR*Sin(th)*Cos(alpha);
-         GLdouble localY = -localR*Cos(th);
-         GLdouble localZ = localR*Sin(th)*Sin(alpha);
-         GLdouble higherX = higherR*Sin(th+5)*Cos(alpha);
-         GLdouble higherY = -higherR*Cos(th+5);
-         GLdouble higherZ = higherR*Sin(th+5)*Sin(alpha);
-         GLdouble highestX = highestR*Sin(th+10)*Cos(alpha);
-         GLdouble highestY = -highestR*Cos(th+10);
-         GLdouble highestZ = highestR*Sin(th+10)*Sin(alpha);
-
-         calcNormal2V(Sin(alpha), 0, -Cos(alpha), higherX-localX, higherY-localY, higherZ-localZ);
-         glVertex3d(localX, localY, localZ);
-         calcNormal2V(Sin(alpha), 0, -Cos(alpha), highestX-higherX, highestY-higherY, highestZ-higherZ);
-         glVertex3d(higherX, higherY, higherZ);
+         float sa, ca, s0, c0, s1, c1, s2, c2;
+         SinCosDeg(alpha, &sa, &ca);
+         SinCosDeg(th, &s0, &c0);
+         SinCosDeg(th+5, &s1, &c1);
+         SinCosDeg(th+10, &s2, &c2);
+         float local[] = {localR*s0*ca, -localR*c0, localR*s0*sa};
+         float higher[] = {higherR*s1*ca, -higherR*c1, higherR*s1*sa};
+         float highest[] = {highestR*s2*ca, -highestR*c2, highestR*s2*sa};
+
+         // normal across the horizontal tangent and the slope up the envelope
+         float tangent[] = {sa, 0, -ca};
+         float slope[3], normal[3];
+         for (int k = 0; k < 3; k++) slope[k] = higher[k]-local[k];
+         Vec3Cross(normal, tangent, slope);
+         glNormal3fv(normal);
+         glVertex3fv(local);
+         for (int k = 0; k < 3; k++) slope[k] = highest[k]-higher[k];
+         Vec3Cross(normal, tangent, slope);
+         glNormal3fv(normal);
+         glVertex3fv(higher);
       }
       glEnd();
    }
    float localR = 1+r* 1/cosh(2.75*(15*M_PI/180 + M_PI_2));
-   GLdouble localY = -localR*Cos(15);
+   float s15, c15;
+   SinCosDeg(15, &s15, &c15);
+   GLdouble localY = -localR*c15;
    glBegin(GL_TRIANGLE_FAN);
    glColor3f(1, 1, 1);
    glVertex3d(0, localY, 0);
    for (int alpha = 0; alpha <= 360; alpha +=5){
+      float sa, ca;
+      SinCosDeg(alpha, &sa, &ca);
       double hsvColor[3] = {alpha, 0.6, 0.5};
       GLfloat rgbColor[3];
       hsvToRgb(hsvColor, rgbColor);
       glColor3f(rgbColor[0], rgbColor[1], rgbColor[2]);
-      glVertex3d(localR*Sin(15)*Cos(alpha), localY, localR*Sin(15)*Sin(alpha));
+      glVertex3d(localR*s15*ca, localY, localR*s15*sa);
    }
    glEnd();
    // 4 strings
-   float stringD = localR*Sin(15)*0.8;
-   float stringR = localR*Sin(15)*0.05;
+   float stringD = localR*s15*0.8;
+   float stringR = localR*s15*0.05;
    for (int i = 0; i < 4; i++){
+      float si, ci;
+      SinCosDeg(i*90, &si, &ci);
       glBegin(GL_QUAD_STRIP);
       glColor3f(1, 1, 1);
       for (int alpha = 0; alpha <= 360; alpha +=45){
-         glNormal3f(Cos(alpha), 0, Sin(alpha));
-         glVertex3d(stringD*Cos(i*90) + stringR*Cos(alpha), localY, stringD*Sin(i*90) + stringR*Sin(alpha));
-         glVertex3d(stringD*Cos(i*90) + stringR*Cos(alpha), localY*1.2, stringD*Sin(i*90) + stringR*Sin(alpha));
+         float sa, ca;
+         SinCosDeg(alpha, &sa, &ca);
+         glNormal3f(ca, 0, sa);
+         glVertex3d(stringD*ci + stringR*ca, localY, stringD*si + stringR*sa);
+         glVertex3d(stringD*ci + stringR*ca, localY*1.2, stringD*si + stringR*sa);
       }
       glEnd();
    }
@@ -207,12 +250,14 @@ static void hotAirBalloon(double x, double y, double z, double r)
    glBindTexture(GL_TEXTURE_2D,myTexture[2]);
    glBegin(GL_QUAD_STRIP);
    for (int alpha = 0; alpha <= 360; alpha +=15){
+      float sa, ca;
+      SinCosDeg(alpha, &sa, &ca);
       glColor3f(1, 0.5, 0.7);
-      glNormal3f(Cos(alpha), 0, Sin(alpha));
+      glNormal3f(ca, 0, sa);
       glTexCoord2f(alpha/45,0);
-      glVertex3d(localR*Sin(15)*Cos(alpha), localY*1.2, localR*Sin(15)*Sin(alpha));
+      glVertex3d(localR*s15*ca, localY*1.2, localR*s15*sa);
       glTexCoord2f(alpha/45,0.3);
-      glVertex3d(localR*Sin(15)*Cos(alpha), localY*1.4, localR*Sin(15)*Sin(alpha));
+      glVertex3d(localR*s15*ca, localY*1.4, localR*s15*sa);
    }
    glEnd();
    glDisable(GL_TEXTURE_2D);
@@ -222,70 +267,77 @@ static void hotAirBalloon(double x, double y, double z, double r)
    glColor3f(1, 0.5, 0.7);
    glNormal3f(0, -1, 0); glVertex3d(0, localY*1.4, 0);
    for (int alpha = 0; alpha <= 360; alpha +=5){
-      glVertex3d(localR*Sin(15)*Cos(alpha), localY*1.4, localR*Sin(15)*Sin(alpha));
+      float sa, ca;
+      SinCosDeg(alpha, &sa, &ca);
+      glVertex3d(localR*s15*ca, localY*1.4, localR*s15*sa);
    }
    glEnd();
 
    glPopMatrix();
+   ProfileEnd();
+}
+
+/* 
+ *  skybox geometry, a unit box into mesh m
+ */
+static void SkyGeometry(mesh_t* m, const double p[])
+{
+   MeshBegin(m,GL_QUADS);
+   MeshTexCoord(m,0.00,0.34); MeshVertex(m,-1,-1,-1);
+   MeshTexCoord(m,0.25,0.34); MeshVertex(m,+1,-1,-1);
+   MeshTexCoord(m,0.25,0.666); MeshVertex(m,+1,+1,-1);
+   MeshTexCoord(m,0.00,0.666); MeshVertex(m,-1,+1,-1);
+
+   MeshTexCoord(m,0.25,0.34); MeshVertex(m,+1,-1,-1);
+   MeshTexCoord(m,0.50,0.34); MeshVertex(m,+1,-1,+1);
+   MeshTexCoord(m,0.50,0.666); MeshVertex(m,+1,+1,+1);
+   MeshTexCoord(m,0.25,0.666); MeshVertex(m,+1,+1,-1);
+
+   MeshTexCoord(m,0.50,0.34); MeshVertex(m,+1,-1,+1);
+   MeshTexCoord(m,0.75,0.34); MeshVertex(m,-1,-1,+1);
+   MeshTexCoord(m,0.75,0.666); MeshVertex(m,-1,+1,+1);
+   MeshTexCoord(m,0.50,0.666); MeshVertex(m,+1,+1,+1);
+
+   MeshTexCoord(m,0.75,0.34); MeshVertex(m,-1,-1,+1);
+   MeshTexCoord(m,1.00,0.34); MeshVertex(m,-1,-1,-1);
+   MeshTexCoord(m,1.00,0.666); MeshVertex(m,-1,+1,-1);
+   MeshTexCoord(m,0.75,0.666); MeshVertex(m,-1,+1,+1);
+
+   //  Top and bottom
+   MeshTexCoord(m,0.25,0.667); MeshVertex(m,+1,+1,-1);
+   MeshTexCoord(m,0.5,0.667); MeshVertex(m,+1,+1,+1);
+   MeshTexCoord(m,0.5,1); MeshVertex(m,-1,+1,+1);
+   MeshTexCoord(m,0.25,1); MeshVertex(m,-1,+1,-1);
+
+   MeshTexCoord(m,0.25,0); MeshVertex(m,-1,-1,+1);
+   MeshTexCoord(m,0.5,0); MeshVertex(m,+1,-1,+1);
+   MeshTexCoord(m,0.5,0.33); MeshVertex(m,+1,-1,-1);
+   MeshTexCoord(m,0.25,0.33); MeshVertex(m,-1,-1,-1);
+   MeshEnd(m);
 }
 
 /* 
- *  skybox
+ *  skybox, drawn with the sky texture bound
  */
 static void Sky(double D)
 {
+   ProfileBegin("Sky");
    //  Textured white box dimension (-D,+D)
    glPushMatrix();
    glScaled(D,D,D);
-   float Emission[] = {0.0,0.0,0.0,1.0};
-   glMaterialfv(GL_FRONT,GL_EMISSION,Emission);
-   glEnable(GL_TEXTURE_2D);
    glColor3f(1,1,1);
 
    //  Sides
-   glBindTexture(GL_TEXTURE_2D,myTexture[1]);
-   glBegin(GL_QUADS);
-   glTexCoord2f(0.00,0.34); glVertex3f(-1,-1,-1);
-   glTexCoord2f(0.25,0.34); glVertex3f(+1,-1,-1);
-   glTexCoord2f(0.25,0.666); glVertex3f(+1,+1,-1);
-   glTexCoord2f(0.00,0.666); glVertex3f(-1,+1,-1);
-
-   glTexCoord2f(0.25,0.34); glVertex3f(+1,-1,-1);
-   glTexCoord2f(0.50,0.34); glVertex3f(+1,-1,+1);
-   glTexCoord2f(0.50,0.666); glVertex3f(+1,+1,+1);
-   glTexCoord2f(0.25,0.666); glVertex3f(+1,+1,-1);
-
-   glTexCoord2f(0.50,0.34); glVertex3f(+1,-1,+1);
-   glTexCoord2f(0.75,0.34); glVertex3f(-1,-1,+1);
-   glTexCoord2f(0.75,0.666); glVertex3f(-1,+1,+1);
-   glTexCoord2f(0.50,0.666); glVertex3f(+1,+1,+1);
-
-   glTexCoord2f(0.75,0.34); glVertex3f(-1,-1,+1);
-   glTexCoord2f(1.00,0.34); glVertex3f(-1,-1,-1);
-   glTexCoord2f(1.00,0.666); glVertex3f(-1,+1,-1);
-   glTexCoord2f(0.75,0.666); glVertex3f(-1,+1,+1);
-
-   //  Top and bottom
-   glTexCoord2f(0.25,0.667); glVertex3f(+1,+1,-1);
-   glTexCoord2f(0.5,0.667); glVertex3f(+1,+1,+1);
-   glTexCoord2f(0.5,1); glVertex3f(-1,+1,+1);
-   glTexCoord2f(0.25,1); glVertex3f(-1,+1,-1);
-
-   glTexCoord2f(0.25,0); glVertex3f(-1,-1,+1);
-   glTexCoord2f(0.5,0); glVertex3f(+1,-1,+1);
-   glTexCoord2f(0.5,0.33); glVertex3f(+1,-1,-1);
-   glTexCoord2f(0.25,0.33); glVertex3f(-1,-1,-1);
-   glEnd();
+   SkyGeometry(NULL,NULL);
+   listDraws++;
 
    //  Undo
-   glDisable(GL_TEXTURE_2D);
    glPopMatrix();
+   ProfileEnd();
 }
+// with myShader in use
 static void waterTest(double x,double y,double z,double s){
-   glUseProgram(myShader);
-   float Emission[] = {0.0,0.0,0.0,1.0};
-   glMaterialfv(GL_FRONT,GL_EMISSION,Emission);
-
+   ProfileBegin("waterTest");
    glColor3f(0.509,0.914,1);
 
    double step = s/40;
@@ -298,10 +350,11 @@ static void waterTest(double x,double y,double z,double s){
       }
       glEnd();
    }
-   glUseProgram(0);
+   ProfileEnd();
 }
 
 static void water(double x,double y,double z,double s){
+   ProfileBegin("water");
    float Emission[] = {0.0,0.0,0.0,1.0};
    glMaterialfv(GL_FRONT,GL_EMISSION,Emission);
 
@@ -322,86 +375,115 @@ static void water(double x,double y,double z,double s){
    // glDisable(GL_BLEND);
    // glDepthMask(1);
    // glDisable(GL_TEXTURE_2D);
+   ProfileEnd();
+}
+
+
+/*
+ *  Radius in pixels of a sphere at x,y,z with radius r
+ */
+static double ProjectedRadius(double x,double y,double z,double r)
+{
+   double dx = x-eye[0];
+   double dy = y-eye[1];
+   double dz = z-eye[2];
+   double d = sqrt(dx*dx+dy*dy+dz*dz);
+   if (d <= r) return viewHeight;
+   return r/(d*tan(fov*M_PI/360))*viewHeight/2;
+}
+
+/*
+ *  Sphere LOD for a projected radius of px pixels
+ *     the level only changes once px is LOD_HYSTERESIS past a threshold,
+ *     so a sphere sitting on a threshold doesn't pop back and forth
+ */
+static int SphereLod(double px, int current)
+{
+   int up = 0, down = 0;
+   for (int k = 0; k < NLOD-1; k++){
+      if (px > lodPixels[k]*(1+LOD_HYSTERESIS)) up++;
+      if (px > lodPixels[k]*(1-LOD_HYSTERESIS)) down++;
+   }
+   if (current < up) return up;
+   if (current > down) return down;
+   return current;
+}
+
+/*
+ *  Triangles in a sphere at the fixed inc
+ *     looked up only when inc changes, so counting costs no cache lookup
+ */
+static int SphereFixedTriangles()
+{
+   static int at = -1, n = 0;
+   if (inc != at){
+      double shape[] = {inc};
+      n = GeoCache(Sphere,1,shape)->count/3;
+      at = inc;
+   }
+   return n;
+}
+
+/*
+ *  Count a sphere at x,y,z with radius r in the sphere stats
+ *     level holds the LOD between frames
+ */
+static void SphereCount(double x,double y,double z,double r,int* level)
+{
+   int fixed = SphereFixedTriangles();
+   if (lod){
+      *level = SphereLod(ProjectedRadius(x,y,z,r), *level);
+      sphereTriangles += sphereLod[*level].count/3;
+   }
+   else
+      sphereTriangles += fixed;
+   sphereFixed += fixed;
 }
 
+/*
+ *  Sphere mesh to draw at x,y,z with radius r
+ *     level holds the LOD between frames
+ */
+static const mesh_t* SphereMesh(double x,double y,double z,double r,int* level)
+{
+   SphereCount(x,y,z,r,level);
+   if (lod) return &sphereLod[*level];
+   double shape[] = {inc};
+   return GeoCache(Sphere,1,shape);
+}
 
 /*
  *  Draw a ball
  *     at (x,y,z)
  *     radius (r)
+ *     level holds the LOD between frames
+ *     the material (shininess 8 for ballColor 1, yellow emission for 2)
+ *     is set by the render queue
  * ballFunction
  */
-static void ball(double x,double y,double z,double r, int ballColor)
+static void ball(double x,double y,double z,double r, int ballColor, int* level)
 {
+   ProfileBegin("ball");
+   const mesh_t* sphere = SphereMesh(x,y,z,r,level);
    //  Save transformation
    glPushMatrix();
    //  Offset, scale and rotate
    glTranslated(x,y,z);
    glScaled(r,r,r);
-   //  White ball with yellow specular
-   float white[]   = {1.0,1.0,1.0,1.0};
-   float Emission[] = {0.0,0.0,0.0,1.0};
+   //  White ball
    glColor3f(1,1,1);
-   glMaterialf(GL_FRONT,GL_SHININESS,1);
 
    if(ballColor == 1){
       glColor3f(1, 0.5, 0.7);
-      // Emission[0] = 1;
-      // Emission[1] = 0.5;
-      // Emission[2] = 0.7;
-      glMaterialf(GL_FRONT,GL_SHININESS,8);
    }else if (ballColor == 2){
       glColor3f(1, 1, 0);
-      Emission[0] = 1;
-      Emission[1] = 1;
-      Emission[2] = 0;
    }
    
-   glMaterialfv(GL_FRONT,GL_SPECULAR,white);
-   glMaterialfv(GL_FRONT,GL_EMISSION,Emission);
-   //  Bands of latitude
-   for (int ph=-90;ph<90;ph+=inc)
-   {
-      glBegin(GL_QUAD_STRIP);
-      for (int th=0;th<=360;th+=2*inc)
-      {
-         Vertex(th,ph);
-         Vertex(th,ph+inc);
-      }
-      glEnd();
-   }
+   //  The radius is a scale, so balls of any size share the unit spheres
+   MeshDraw(sphere);
    //  Undo transofrmations
    glPopMatrix();
-}
-
-void CrossProduct(double vect_A[], double vect_B[], double cross_P[]){
-   // vectorc = vectora x vectorb
-   //a*b = (y1z2 - z1y2,z1x2 - x1z2,x1y2 - x2y1)
-   cross_P[0] = vect_A[1] * vect_B[2] - vect_A[2] * vect_B[1];
-   cross_P[1] = vect_A[2] * vect_B[0] - vect_A[0] * vect_B[2];
-   cross_P[2] = vect_A[0] * vect_B[1] - vect_A[1] * vect_B[0];
-}
-
-double dotProduct(double vect_A[], double vect_B[])
-{
- 
-    double product = 0;
- 
-    // Loop for calculate dot product
-    for (int i = 0; i < 3; i++)
- 
-        product = product + vect_A[i] * vect_B[i];
-    return product;
-}
-
-void Normalize(double vect_A[]){
-   // vectorc = vectora x vectorb
-   //a*b = (y1z2 - z1y2,z1x2 - x1z2,x1y2 - x2y1)
-   double norm = sqrt(vect_A[0]*vect_A[0] + vect_A[1] * vect_A[1] + vect_A[2] * vect_A[2]);
-   vect_A[0] /= norm;
-   vect_A[1] /= norm;
-   vect_A[2] /= norm;
-
+   ProfileEnd();
 }
 
 /*
@@ -412,520 +494,796 @@ rotated ph along the x axis
 rotated th along the y axis
 */
 static void TubeFunction(double x, double y, double z, double R, double tuber, int tubeDegree, float ph, float th, int tubeColor){
+   ProfileBegin("TubeFunction");
    glPushMatrix();
    glTranslated(x, y, z);
    glRotatef(th,0,1,0);
    glRotatef(ph,1,0,0);
 
-   float tubeColorArray[2][4] = {{1, 1, 1, 1}, {1, 0, 1, 0.3}};
-   if(tubeColor == 1){
-      glEnable(GL_BLEND);
-      glBlendFunc(GL_SRC_ALPHA,GL_ONE);
-      glDepthMask(0);
-   }
-   
-
-   glColor4f(tubeColorArray[tubeColor][0], tubeColorArray[tubeColor][1],tubeColorArray[tubeColor][2],tubeColorArray[tubeColor][3]);
-   // inner and outer surface of the tube
-   double resolution = 9;
-   for(int flip = 1; flip < 3; flip ++){
-      // outter loop = 1.4*tuber
-      double localtuber = (1+(flip-1)*0.4)*tuber;
-      for(double i = 0; i < 90; i+= resolution){
-         double tubex = R*Cos(i);
-         double tubey = -R*Sin(i);
-         double dv[] = {tubey, -tubex, 0};
-         Normalize(dv);
-         double perpendicular[] = {0, 0, 1};
-         double cross_product[3];
-         CrossProduct(dv, perpendicular, cross_product);
-         Normalize(cross_product);
-         double dot_product = dotProduct(dv, perpendicular);
-
-         double tubex1 = R*Cos(i+resolution);
-         double tubey1 = -R*Sin(i+resolution);
-         double dv1[] = {tubey1, -tubex1, 0};
-         Normalize(dv1);
-         double cross_product1[3];
-         CrossProduct(dv1, perpendicular, cross_product1);
-         Normalize(cross_product1);
-         double dot_product1 = dotProduct(dv1, perpendicular);
-
-         double normalCalc = 2*flip-3;
-         glBegin(GL_QUAD_STRIP);
-         for(int j = 0; j >= -tubeDegree; j-=30){
-
-            double b_rotate[] = 
-            {
-               perpendicular[0]*Cos(j) + cross_product[0]*Sin(j)+dv[0]*dot_product*(1-Cos(j)),
-               perpendicular[1]*Cos(j) + cross_product[1]*Sin(j)+dv[1]*dot_product*(1-Cos(j)),
-               perpendicular[2]*Cos(j) + cross_product[2]*Sin(j)+dv[2]*dot_product*(1-Cos(j)),
-            };
-
-            glNormal3d(b_rotate[0]*normalCalc,b_rotate[1]*normalCalc,b_rotate[2]*normalCalc);
-            glVertex3d(tubex+b_rotate[0]*localtuber,tubey+b_rotate[1]*localtuber,b_rotate[2]*localtuber);
-
-            double b_rotate1[] = 
-            {
-               perpendicular[0]*Cos(j) + cross_product1[0]*Sin(j)+dv1[0]*dot_product1*(1-Cos(j)),
-               perpendicular[1]*Cos(j) + cross_product1[1]*Sin(j)+dv1[1]*dot_product1*(1-Cos(j)),
-               perpendicular[2]*Cos(j) + cross_product1[2]*Sin(j)+dv1[2]*dot_product1*(1-Cos(j)),
-            };
-            glNormal3d(b_rotate1[0]*normalCalc,b_rotate1[1]*normalCalc,b_rotate1[2]*normalCalc);
-            glVertex3d(tubex1+b_rotate1[0]*localtuber,tubey1+b_rotate1[1]*localtuber,b_rotate1[2]*localtuber);
-         }
-         glEnd();
-      }
-   }
-   if(tubeColor == 0) glColor3f(1, 0.95, 0.509);
-   // side
-   if(tubeDegree != 360){    
-      for (int j = 0; j < 2; j++){
-         glBegin(GL_QUAD_STRIP);
-         for(double i = 0; i <= 90; i+= resolution){
-            double tubex = R*Cos(i);
-            double tubey = -R*Sin(i);
-            glNormal3d(-Cos(i), Sin(i), 0);
-            glVertex3d(tubex, tubey, (j*2-1)*tuber);
-            glVertex3d(tubex, tubey, (j*2-1)*tuber*1.4);
-         }
-         glEnd();
-      }
-   }
-   
-
-   // top and bottom
-   glBegin(GL_QUAD_STRIP);
-   glNormal3d(0, 1, 0);
-   for(int j = 0; j <= tubeDegree; j+=30){
-      glVertex3d(R+tuber*Sin(j), 0, tuber*Cos(j));
-      glVertex3d(R+tuber*Sin(j)*1.4, 0, tuber*Cos(j)*1.4);
-   }
-   glEnd();
-
-   glBegin(GL_QUAD_STRIP);
-   glNormal3d(-1, 0, 0);
-   for(int j = 0; j >= -tubeDegree; j-=30){
-      glVertex3d(0, -R+tuber*Sin(j), tuber*Cos(j));
-      glVertex3d(0, -R+tuber*Sin(j)*1.4, tuber*Cos(j)*1.4);
-   }
-   glEnd();
+   // the transparent tube (tubeColor 1) is drawn in the transparent pass
+   double shape[] = {R, tuber, tubeDegree, tubeColor};
+   MeshDraw(GeoCache(TubeGeometry,4,shape));
 
-   // reset the settings
-   if (tubeColor == 1)
-   {
-      glDisable(GL_BLEND);
-      glDepthMask(1);
-      glDisable(GL_TEXTURE_2D);
-   }
    glPopMatrix();
 
 
+   ProfileEnd();
 }
 
 /*
- *  Draw a car
+ *  Place a car and its two emissive balls in the transform hierarchy
  *     at (x,y,z)
  *     with w in width, l in length and h in height
  *     rotated th about the y axis
  */
+static void PlaceCar(int car, const int balls[2],
+                     double x,double y,double z,
+                     double w,double l,double h,
+                     double th)
+{
+   float M[16];
+   InstanceMatrix(M,NULL,x,y,z,th,1);
+   XformLocal(car,M);
+   InstanceMatrix(M,NULL,-l*5/12, -h/12, w*5/12,0,w/12);
+   XformLocal(balls[0],M);
+   InstanceMatrix(M,NULL,-l*5/12, -h/12, -w*5/12,0,w/12);
+   XformLocal(balls[1],M);
+}
+
+/*
+ *  Draw a car placed by PlaceCar
+ *     with w in width, l in length and h in height
+ */
 
-void drawCar(double x,double y,double z,
-            double w,double l,double h,
-            double th)
+void drawCar(int car, const int balls[2],
+             double w,double l,double h)
 {
+   ProfileBegin("drawCar");
    float red[]  = {1.0,0.0,0.0,1.0};
-   float white[]  = {1.0,1.0,1.0,1.0};
-   float Emission[] = {0.0,0.0,0.0,1.0};
-   glMaterialfv(GL_FRONT,GL_EMISSION,Emission);
-   glMaterialfv(GL_FRONT_AND_BACK,GL_SPECULAR,white);
-   glMaterialf(GL_FRONT_AND_BACK,GL_SHININESS,shiny);
 
    //  Draw the Car
    glPushMatrix();
-   //  Offset
-   glTranslated(x,y,z);
-   glRotatef(th,0,1,0);
-
-   glBegin(GL_QUADS);
-
-   // wrap around the car
-   glColor3f(1, 0, 0);
-   calcNormal(-l/2, -h/2, w/2, -l/2, -h/2, -w/2, -5*l/12, 0, w/2);
-   glVertex3f(-l/2, -h/2, w/2);
-   glVertex3f(-l/2, -h/2, -w/2);
-   glVertex3f(-5*l/12, 0, -w/2);
-   glVertex3f(-5*l/12, 0, w/2);
-
-   calcNormal(-5*l/12, 0, w/2, -5*l/12, 0, -w/2, -l/4, 0, w/2);
-   glVertex3f(-5*l/12, 0, w/2);
-   glVertex3f(-5*l/12, 0, -w/2);
-   glVertex3f(-l/4, 0, -w/2);
-   glVertex3f(-l/4, 0, w/2);
-
-   // （glass color）
-   glColor3f(1, 1, 1);
-   calcNormal(-l/4, 0, w/2, -l/4, 0, -w/2, -l/6, h/2, w/2);
-   glVertex3f(-l/4, 0, w/2);
-   glVertex3f(-l/4, 0, -w/2);
-   glVertex3f(-l/6, h/2, -w/2);
-   glVertex3f(-l/6, h/2, w/2);
-
-   glColor3f(1, 0, 0);
-   calcNormal(-l/6, h/2, w/2, -l/6, h/2, -w/2, l/6, h/2, w/2);
-   glVertex3f(-l/6, h/2, w/2);
-   glVertex3f(-l/6, h/2, -w/2);
-   glVertex3f(l/6, h/2, -w/2);
-   glVertex3f(l/6, h/2, w/2);
-
-   calcNormal(l/6, h/2, w/2, l/6, h/2, -w/2, l/4, 0, w/2);
-   glVertex3f(l/6, h/2, w/2);
-   glVertex3f(l/6, h/2, -w/2);
-   glVertex3f(l/4, 0, -w/2);
-   glVertex3f(l/4, 0, w/2);
-
-   calcNormal(l/4, 0, w/2, l/4, 0, -w/2, 5*l/12, 0, w/2);
-   glVertex3f(l/4, 0, w/2);
-   glVertex3f(l/4, 0, -w/2);
-   glVertex3f(5*l/12, 0, -w/2);
-   glVertex3f(5*l/12, 0, w/2);
-
-   calcNormal(5*l/12, 0, w/2, 5*l/12, 0, -w/2, l/2, -h/2, w/2);
-   glVertex3f(5*l/12, 0, w/2);
-   glVertex3f(5*l/12, 0, -w/2);
-   glVertex3f(l/2, -h/2, -w/2);
-   glVertex3f(l/2, -h/2, w/2);
-
-   calcNormal(l/2, -h/2, w/2, l/2, -h/2, -w/2, -l/2, -h/2, w/2);
-   glVertex3f(l/2, -h/2, w/2);
-   glVertex3f(l/2, -h/2, -w/2);
-   glVertex3f(-l/2, -h/2, -w/2);
-   glVertex3f(-l/2, -h/2, w/2);
-
-   glEnd();
-
-   // side
-   float tempW = w/2;
-   for (int i=0; i<2;i++){
-
-      glNormal3f(0, 0, tempW);
-
-      glBegin(GL_QUAD_STRIP);
-      glColor3f(1, 0.4, 0.4);
-
-      glVertex3f(-l/2, -h/2, tempW);
-      glVertex3f(-5*l/12, 0, tempW);
-      
-      glVertex3f(-l/4, -h/2, tempW);
-      glVertex3f(-l/4, 0, tempW);
-
-      glVertex3f(-l/6, -h/2, tempW);
-      glVertex3f(-l/6, h/2, tempW);
-
-      glVertex3f(l/6, -h/2, tempW);
-      glVertex3f(l/6, h/2, tempW);
-
-      glVertex3f(l/4, -h/2, tempW);
-      glVertex3f(l/4, 0, tempW);
-
-      glVertex3f(l/2, -h/2, tempW);
-      glVertex3f(5*l/12, 0, tempW);
-      glEnd();
-
-      // draw the other side
-      tempW *= -1;
-   }
-   //  wheels
-   glColor3f(1,1,0);
-   // the x and z position of the side face of all wheels
-   float const wheelCenter [8][2] = 
-   {
-    {l/4, 7*w/12},
-    {l/4, 5*w/12},
-    {l/4, -5*w/12},
-    {l/4, -7*w/12},
-    {-l/4, 7*w/12},
-    {-l/4, 5*w/12},
-    {-l/4, -5*w/12},
-    {-l/4, -7*w/12}
-   };
-   float r = l/12;
-   for (int i = 0; i < 8; i++){
-      glBegin(GL_TRIANGLE_FAN);
-      glNormal3f(0, 0, 1-i%2*2);
-      // check it
-
-      glVertex3d(wheelCenter[i][0], -h/2, wheelCenter[i][1]);
-      for (int th=0;th<=360;th+=45)
-         glVertex3d(wheelCenter[i][0]+Cos(th)*r, -h/2+Sin(th)*r,wheelCenter[i][1]);
-      glEnd();
-   }
-   
-   for (int i = 0; i < 8; i+=2){
-      glBegin(GL_QUAD_STRIP);
-      for (int th=0;th<=360;th+=45){
-         glNormal3f(Cos(th), Sin(th), 0);
-         glVertex3d(wheelCenter[i][0]+Cos(th)*r, -h/2+Sin(th)*r,wheelCenter[i][1]);
-         glVertex3d(wheelCenter[i+1][0]+Cos(th)*r, -h/2+Sin(th)*r,wheelCenter[i+1][1]);
-      }
-      glNormal3f(1, 0, 0);
-      glVertex3d(wheelCenter[i][0]+Cos(0)*r, -h/2+Sin(0)*r,wheelCenter[i][1]);
-      glVertex3d(wheelCenter[i+1][0]+Cos(0)*r, -h/2+Sin(0)*r,wheelCenter[i+1][1]);
-      glEnd();
-   }
-   ball(-l*5/12, -h/12, w*5/12, w/12, 2);
-   ball(-l*5/12, -h/12, -w*5/12, w/12, 2);
+   glMultMatrixf(XformWorld(car));
 
+   double shape[] = {w, l, h};
+   MeshDraw(GeoCache(CarGeometry,3,shape));
 
    //  Undo transformations
    glPopMatrix();
 
+   //  emissive yellow balls, instanced in world coordinates
+   float yellow[] = {1,1,0,1};
+   InstanceAdd(ballInstance,XformWorld(balls[0]),yellow,yellow);
+   InstanceAdd(ballInstance,XformWorld(balls[1]),yellow,yellow);
+   InstanceFlushMesh(ballInstance);
+   ProfileEnd();
 }
 
-void BallUpdate(){
-   if(bally>=0){
-      ballt += 0.02;
+/*
+ *  State of everything that moves, advanced by the simulation thread
+ */
+typedef struct {
+   double t;         // simulated seconds, the water clock
+   double orbit;     // seconds the light has orbited
+   float ballx, bally, ballt;
+   int resets;       // ball resets done
+} sim_t;
+
+/*
+ *  Advance the light orbit, the ball and the clock by dt seconds
+ */
+static void SimUpdate(void* state, double dt){
+   sim_t* s = (sim_t*)state;
+   s->t += dt;
+   if (move) s->orbit += dt;
+   int resets = ballResets;
+   if (s->resets != resets){
+      s->resets = resets;
+      s->ballx = s->bally = 2;
+      s->ballt = 0;
+   }
+   if(s->bally>=0){
+      // ball time runs at 0.6x, as 0.02 every 33ms did when drawn
+      s->ballt += 0.6*dt;
       float g = 9.8;
       // g * t * t / 2
-      float distance = g*ballt*ballt/2;
-      bally = 2 - distance;
-      ballx = sqrt(4 - distance * distance);
+      float distance = g*s->ballt*s->ballt/2;
+      s->bally = 2 - distance;
+      s->ballx = sqrt(4 - distance * distance);
    }
-   
+}
+
+/*
+ *  Show the simulation blended between its last two steps
+ */
+static void SimFrame(){
+   sim_t a, b;
+   double w = SimRead(&a, &b);
+   t = a.t + w*(b.t-a.t);
+   zh = fmod(90*(a.orbit + w*(b.orbit-a.orbit)), 360.0);
+   ballx = a.ballx + w*(b.ballx-a.ballx);
+   bally = a.bally + w*(b.bally-a.bally);
+   resetsSeen = b.resets;
+}
+
+/*
+ *  Whether anything on screen changes with time
+ *     the light orbits unless frozen and the ball falls until it lands
+ *     (the water is static: the animated water() is not drawn)
+ */
+static int Animating()
+{
+   return move || bally >= 0 || resetsSeen != ballResets;
 }
 
 void DisplayModel(double x, double y, double z, int model)
 {
+   ProfileBegin("DisplayModel");
    glPushMatrix();
    glTranslated(x, y, z);
    glCallList(myModels[model]);
    glPopMatrix();
+   listDraws++;
+   ProfileEnd();
 }
 
 
-void DisplayRocks(int numbers)
+void DisplayRock(int i)
 {
-   for (int i = 0; i < numbers; i++){
-      glPushMatrix();
-      glTranslated(rockPosition[i].x, -dim*3, rockPosition[i].z);
-      if (rockPosition[i].style != 3) glScaled(4, 4, 4);
-      glColor3d(0.553, 0.553, 0.56);
-      glCallList(myModels[rockPosition[i].style]);
-      glPopMatrix();
-   }
-   
+   ProfileBegin("DisplayRock");
+   float grey[] = {0.553, 0.553, 0.56, 1};
+   float M[16];
+   int style = rockPosition[i].style;
+   InstanceMatrix(M,NULL,rockPosition[i].x, -dim*3, rockPosition[i].z,0,style != 3 ? 4 : 1);
+   InstanceAdd(rockInstance[style],M,grey,NULL);
+   InstanceFlushMesh(rockInstance[style]);
+   ProfileEnd();
 }
 
 // draw a hexagonal column with radius r and height h at x, y, z
-// if the hexagonal is the top layer, it will have some grass on it
 void DrawHexagonal(double x, double y, double z, double r, double h, int top){
-   float lightbrown[]  = {0.91,0.78,0.6};
-   float darkbrown[]  = {0.796,0.58,0.376};
-   float lightgreen[]  = {0.631,0.8,0.227};
-   float darkgreen[]  = {0.039,0.545,0.329};
-   glPushMatrix();
-   glTranslated(x, y, z);
+   HexColumn(NULL, x, y, z, r, h, top, 0);
+}
 
-   glBegin(GL_TRIANGLE_FAN);
-   glColor3d(lightbrown[0], lightbrown[1], lightbrown[2]);
-   if(top){
-      glColor3d(lightgreen[0], lightgreen[1], lightgreen[2]);
-   }
-   glNormal3d(0, 1, 0);
-   glVertex3d(0, 0, 0);
-   for (int i = 0; i <= 360; i += 60){
-      glVertex3d(r*Cos(i), 0, r*Sin(i));
+/*
+ *  Build the island into one mesh
+ *     layer i (from the top) holds the columns less than layer-i rings from the center
+ *     columns sit on an axial hex grid with centers 2r apart, so their radius
+ *     is widened to 2r/sqrt(3) to close the gaps between neighbors
+ *     faces shared with a neighbor or the layer above/below are dropped
+ */
+static void IslandMesh(mesh_t* m, double x, double y, double z, int layer, double r, double h){
+   // axial neighbor offsets, in the order of the sides facing 30, 90, ... 330 degrees
+   const int dq[6] = {1, 0, -1, -1, 0, 1};
+   const int ds[6] = {0, 1, 1, 0, -1, -1};
+   // axial basis, 30 and 90 degrees with length 2r
+   double ax = 2*r*Cos(30), az = 2*r*Sin(30);
+   double bx = 0, bz = 2*r;
+   double R = 2*r/sqrt(3);
+   int n = layer;
+   int before = 0, after = 0;
+
+   // faces drawn by the original ring loop (with its duplicate columns)
+   for (int i = 0; i < layer; i++){
+      int columns = 1;
+      for (int j = 1; j < layer - i; j++)
+         for (double k = 0; k < 360; k += 60/j)
+            columns++;
+      before += columns * (i == 0 ? 14 : 8);
    }
-   glEnd();
 
-   glBegin(GL_TRIANGLE_FAN);
-   glColor3d(darkbrown[0], darkbrown[1], darkbrown[2]);
-   glNormal3d(0, -1, 0);
-   glVertex3d(0, -h, 0);
-   for (int i = 0; i <= 360; i += 60){
-      glVertex3d(r*Cos(i), -h, r*Sin(i));
+   // column at axial q,s in layer i
+   #define COLUMN(q,s,i) ((i) >= 0 && (i) < layer && (abs(q)+abs(s)+abs((q)+(s)))/2 < layer-(i))
+   for (int i = 0; i < layer; i++){
+      for (int q = -n; q <= n; q++){
+         for (int s = -n; s <= n; s++){
+            if (!COLUMN(q,s,i)) continue;
+            int hide = 0;
+            if (COLUMN(q,s,i-1)) hide |= HEX_TOP;
+            if (COLUMN(q,s,i+1)) hide |= HEX_BOTTOM;
+            for (int k = 0; k < 6; k++)
+               if (COLUMN(q+dq[k],s+ds[k],i)) hide |= HEX_SIDE<<k;
+            after += HexColumn(m, x+q*ax+s*bx, y-h*i, z+q*az+s*bz, R, h, i == 0, hide);
+         }
+      }
    }
-   glEnd();
+   #undef COLUMN
+   islandFaces = before;
+   islandKept = after;
+}
 
-   if (top){
-      glBegin(GL_QUADS);
-      for (int i = 0; i < 360; i += 60){
-         glNormal3d(Cos(i+30), 0, Sin(i+30));
-         glColor3d(lightbrown[0], lightbrown[1], lightbrown[2]);
-         glVertex3d(r*Cos(i), -h/2, r*Sin(i));
-         glColor3d(darkbrown[0], darkbrown[1], darkbrown[2]);
-         glVertex3d(r*Cos(i), -h, r*Sin(i));
-         glVertex3d(r*Cos(i+60), -h, r*Sin(i+60));
-         glColor3d(lightbrown[0], lightbrown[1], lightbrown[2]);
-         glVertex3d(r*Cos(i+60), -h/2, r*Sin(i+60));
-      }
-      glEnd();
+// the island mesh for these parameters
+static const mesh_t* Island(double x, double y, double z, double layer, double r, double h){
+   // the merged mesh is rebuilt only when the island changes
+   static double meshX, meshY, meshZ, meshLayer = -1, meshR, meshH;
+   if (x != meshX || y != meshY || z != meshZ || layer != meshLayer || r != meshR || h != meshH){
+      MeshFree(&islandMesh);
+      IslandMesh(&islandMesh, x, y, z, layer, r, h);
+      MeshUpload(&islandMesh);
+      meshX = x; meshY = y; meshZ = z;
+      meshLayer = layer; meshR = r; meshH = h;
+   }
+   return &islandMesh;
+}
 
-      glBegin(GL_QUADS);
-      for (int i = 0; i < 360; i += 60){
-         glNormal3d(Cos(i+30), 0, Sin(i+30));
-         glColor3d(lightgreen[0], lightgreen[1], lightgreen[2]);
-         glVertex3d(r*Cos(i), 0, r*Sin(i));
-         glColor3d(darkgreen[0], darkgreen[1], darkgreen[2]);
-         glVertex3d(r*Cos(i), -h/2, r*Sin(i));
-         glVertex3d(r*Cos(i+60), -h/2, r*Sin(i+60));
-         glColor3d(lightgreen[0], lightgreen[1], lightgreen[2]);
-         glVertex3d(r*Cos(i+60), 0, r*Sin(i+60));
-      }
-      glEnd();
+void DrawIsland(double x, double y, double z, double layer, double r, double h){
+   ProfileBegin("DrawIsland");
+   MeshDraw(Island(x, y, z, layer, r, h));
+   ProfileEnd();
+}
 
-   }else{
-      glBegin(GL_QUADS);
-      for (int i = 0; i < 360; i += 60){
-         glColor3d(lightbrown[0], lightbrown[1], lightbrown[2]);
-         glNormal3d(Cos(i+30), 0, Sin(i+30));
-         glVertex3d(r*Cos(i), 0, r*Sin(i));
-         glColor3d(darkbrown[0], darkbrown[1], darkbrown[2]);
-         glVertex3d(r*Cos(i), -h, r*Sin(i));
-         glVertex3d(r*Cos(i+60), -h, r*Sin(i+60));
-         glColor3d(lightbrown[0], lightbrown[1], lightbrown[2]);
-         glVertex3d(r*Cos(i+60), 0, r*Sin(i+60));
-      }
-      glEnd();
+/*
+ *  One ball of the instancing stress test
+ *     10k small balls on a 100x100 grid above the scene
+ *     the visible ones are listed here and queued as instances by
+ *     StressDraw from the render queue, so no other draw flushes them
+ */
+static void StressBall(int k){
+   if (stressVisible < 10000)
+      stressList[stressVisible++] = k;
+}
+static void StressQueue(int k){
+   int n = 100;
+   int i = k/n, j = k%n;
+   double hsv[3] = {360.0*i/n, 0.6, 0.9};
+   float rgb[4] = {0,0,0,1};
+   float M[16];
+   hsvToRgb(hsv, rgb);
+   double x = (i-n/2)*0.3, z = (j-n/2)*0.3;
+   int level = stressLod[k];
+   SphereCount(x, 6, z, 0.1, &level);
+   stressLod[k] = level;
+   InstanceMatrix(M,NULL,x, 6, z, 0, 0.1);
+   InstanceAdd(lod ? sphereLodInstance[level] : ballInstance,M,rgb,NULL);
+}
 
-   }
-   
+/*
+ *  World matrix for a static object
+ *     translate x,y,z, rotate th about y, ph about x, then scale s
+ */
+static void StaticMatrix(float M[16], double x, double y, double z, double th, double ph, double s){
+   glPushMatrix();
+   glLoadIdentity();
+   glTranslated(x,y,z);
+   glRotated(th,0,1,0);
+   glRotated(ph,1,0,0);
+   glScaled(s,s,s);
+   glGetFloatv(GL_MODELVIEW_MATRIX,M);
    glPopMatrix();
 }
 
-void DrawIsland(double x, double y, double z, double layer, double r, double h){
+/*
+ *  Add build(p) to a static batch
+ */
+static void StaticAdd(int batch, geobuild_t build, const double p[], const float M[16], const float color[4]){
+   mesh_t m;
+   MeshInit(&m);
+   build(&m,p);
+   MeshAppend(&staticBatch[batch].mesh,&m,M,color);
+   MeshFree(&m);
+}
 
-   for (int i = 0; i < layer; i++){
-      int toplayer = 0;
-      if(i == 0) toplayer = 1;
-      DrawHexagonal(x, y-h*i, z, r, h, toplayer);   
-      int round = layer - i;
-      for (int j = 1; j < round; j++){
-         double angle = 60/j;
-         for (double k = 0; k < 360; k+= angle){
-            int angleShift = j%2;
-            DrawHexagonal(x+Cos(k+angleShift*angle/2)*2*r*j, y-h*i, z+Sin(k+angleShift*angle/2)*2*r*j, r, h, toplayer);
-         }
-      }
-         
+/*
+ *  Bake the static objects into one buffer per material
+ *     keep in step with the object nodes in BuildScene
+ */
+static void BakeStatic(){
+   float white[] = {1,1,1,1};
+   float yellow[] = {1,1,0,1};
+   float M[16];
+   int objects = 0;
+
+   for (int k = 0; k < NSTATIC; k++){
+      static_t* b = &staticBatch[k];
+      MeshFree(&b->mesh);
+      b->texture = 0;
+      b->specular = 1;
+      b->shininess = shiny;
+      b->emission[0] = b->emission[1] = b->emission[2] = 0;
+      b->emission[3] = 1;
+      b->transparent = 0;
+   }
+   staticBatch[STATIC_EMISSIVE].shininess = 1;
+   memcpy(staticBatch[STATIC_EMISSIVE].emission, yellow, sizeof(yellow));
+   // cactus material from cactus_medium_A.mtl
+   staticBatch[STATIC_CACTUS].texture = myTexture[3];
+   staticBatch[STATIC_CACTUS].specular = 0.5;
+   staticBatch[STATIC_CACTUS].shininess = 128;
+   staticBatch[STATIC_SKY].texture = myTexture[1];
+   staticBatch[STATIC_TUBE].transparent = 1;
+
+   // car body and its emissive balls
+   double car[] = {1, 2, 1};
+   double sphere[] = {inc};
+   StaticMatrix(M, 0, 2, 0, 0, 0, 1);
+   StaticAdd(STATIC_OPAQUE, CarGeometry, car, M, NULL);
+   StaticMatrix(M, -car[1]*5/12, 2-car[2]/12, car[0]*5/12, 0, 0, car[0]/12);
+   StaticAdd(STATIC_EMISSIVE, Sphere, sphere, M, yellow);
+   StaticMatrix(M, -car[1]*5/12, 2-car[2]/12, -car[0]*5/12, 0, 0, car[0]/12);
+   StaticAdd(STATIC_EMISSIVE, Sphere, sphere, M, yellow);
+   objects += 3;
+   // skybox
+   StaticMatrix(M, 0, 0, 0, 0, 0, 3.5*dim);
+   StaticAdd(STATIC_SKY, SkyGeometry, NULL, M, white);
+   objects++;
+   // cactus
+   StaticMatrix(M, 4, 0, 0, 0, 0, 1);
+   MeshAppend(&staticBatch[STATIC_CACTUS].mesh, &cactusMesh, M, white);
+   objects++;
+   // the rocks stay separate nodes so they can be occlusion culled
+   // tubes
+   double tube[] = {2, 0.2, 180, 0};
+   StaticMatrix(M, 0, 2, 0, 0, 0, 1);
+   StaticAdd(STATIC_OPAQUE, TubeGeometry, tube, M, NULL);
+   double glass[] = {2, 0.2, 360, 1};
+   StaticMatrix(M, 0, 0, 2, 90, 90, 1);
+   StaticAdd(STATIC_TUBE, TubeGeometry, glass, M, NULL);
+   objects += 2;
+   // island
+   MeshAppend(&staticBatch[STATIC_OPAQUE].mesh, Island(0, 0, 0, 5, 0.5, 0.5), NULL, NULL);
+   objects++;
+
+   int triangles = 0;
+   for (int k = 0; k < NSTATIC; k++){
+      MeshUpload(&staticBatch[k].mesh);
+      triangles += staticBatch[k].mesh.ni/3;
+   }
+   staticObjects = objects;
+   staticTriangles = triangles;
+   // the batches are in world coordinates, so their vertexes are their bounds
+   for (int k = 0; k < NSTATIC; k++){
+      bounds_t bounds;
+      BoundsMesh(&bounds, &staticBatch[k].mesh);
+      SceneMove(batchNode[k], &bounds);
+      memcpy(staticBatch[k].center, bounds.center, sizeof(bounds.center));
+   }
+   staticDirty = 0;
+   ShadowInvalidate();
+}
+
+/*
+ *  Draw baked static batch k
+ */
+static void BatchDraw(int k){
+   ProfileBegin("BatchDraw");
+   MeshDraw(&staticBatch[k].mesh);
+   ProfileEnd();
+}
 
+/*
+ *  Scene node draw functions, the state is set by the render queue
+ */
+static void LightDraw(int arg){
+   ball(lightPosition[0],lightPosition[1],lightPosition[2] , 0.1, 0, &lightLod);
+}
+static void BallDraw(int arg){
+   ball(ballx, bally, 0 , 0.2, 1, &ballLod);
+}
+static void CarDraw(int arg){
+   drawCar(carXform, carBall, 1, 2, 1);
+}
+static void SkyDraw(int arg){
+   Sky(3.5*dim);
+}
+static void CactusDraw(int arg){
+   DisplayModel(4, 0, 0, 0);
+}
+static void RockDraw(int i){
+   DisplayRock(i);
+}
+static void TubeDraw(int transparent){
+   if (transparent)
+      TubeFunction(0, 0, 2, 2, 0.2, 360, 90, 90, 1);
+   else
+      TubeFunction(0, 2, 0, 2, 0.2, 180, 0, 0, 0);
+}
+static void IslandDraw(int arg){
+   DrawIsland(0, 0, 0, 5, 0.5, 0.5);
+}
+static void WaterDraw(int arg){
+   // draw a water surface as big as the skybox
+   // water(0,-2,0,3.5*dim*2);
+   waterTest(0,-5,0,3.5*dim*2);
+}
+static void BalloonDraw(int arg){
+   hotAirBalloon(2,4.2,0,40);
+}
+static void LanternDraw(int arg){
+   ProfileBegin("LanternDraw");
+   // one emissive ball per lantern past the car balls and the balloon
+   float M[16];
+   for (int k = 3; k < pointLights; k++){
+      const pointlight_t* l = &pointLight[k];
+      InstanceMatrix(M, NULL, l->position[0], l->position[1], l->position[2], 0, 0.06);
+      InstanceAdd(ballInstance, M, l->color, l->color);
    }
+   InstanceFlushMesh(ballInstance);
+   ProfileEnd();
+}
+static void StressDraw(int arg){
+   ProfileBegin("StressDraw");
+   // the balls the stress field nodes found visible
+   for (int k = 0; k < stressVisible; k++)
+      StressQueue(stressList[k]);
+   stressVisible = 0;
+   InstanceFlushMesh(ballInstance);
+   for (int k = 0; k < NLOD; k++)
+      InstanceFlushMesh(sphereLodInstance[k]);
+   ProfileEnd();
 }
 
+/*
+ *  Shadow casters, the static batches and the moving objects
+ */
+static void ShadowStatic(int arg){
+   MeshDraw(&staticBatch[STATIC_OPAQUE].mesh);
+   MeshDraw(&staticBatch[STATIC_EMISSIVE].mesh);
+   MeshDraw(&staticBatch[STATIC_CACTUS].mesh);
+}
+static void ShadowDynamic(int arg){
+   // the ball at the level it is drawn at, kept out of the sphere counts
+   double shape[] = {inc};
+   const mesh_t* sphere = lod ? &sphereLod[ballLod] : GeoCache(Sphere,1,shape);
+   glPushMatrix();
+   glTranslated(ballx, bally, 0);
+   glScaled(0.2, 0.2, 0.2);
+   MeshDraw(sphere);
+   glPopMatrix();
+   hotAirBalloon(2, 4.2, 0, 40);
+}
 
 /*
- *  Read text file
+ *  Material with white specular
  */
-char* ReadText(char *file)
-{
-   char* buffer;
-   //  Open file
-   FILE* f = fopen(file,"rt");
-   if (!f) Fatal("Cannot open text file %s\n",file);
-   //  Seek to end to determine size, then rewind
-   fseek(f,0,SEEK_END);
-   int n = ftell(f);
-   rewind(f);
-   //  Allocate memory for the whole file
-   buffer = (char*)malloc(n+1);
-   if (!buffer) Fatal("Cannot allocate %d bytes for text file %s\n",n+1,file);
-   //  Snarf the file
-   if (fread(buffer,n,1,f)!=1) Fatal("Cannot read %d bytes for text file %s\n",n,file);
-   buffer[n] = 0;
-   //  Close and return
-   fclose(f);
-   return buffer;
+static int WhiteMaterial(float shininess, const float emission[4]){
+   float white[] = {1,1,1,1};
+   float black[] = {0,0,0,1};
+   return RenderMaterial(white, shininess, emission ? emission : black);
+}
+
+/*
+ *  Queue a draw with its state at x,y,z
+ */
+static void Submit(int pass, int program, int texture, int material, int dirty,
+                   double x, double y, double z, scenedraw_t draw, int arg){
+   rstate_t state = {pass, program, texture, material, dirty};
+   RenderSubmit(&state, x, y, z, draw, arg);
 }
 
+/*
+ *  Queue a transparent draw, order independent or additive
+ */
+static void SubmitTransparent(int material, double x, double y, double z, scenedraw_t draw, int arg){
+   if (oit)
+      Submit(RENDER_OIT, oitShader, 0, material, 0, x, y, z, draw, arg);
+   else
+      Submit(RENDER_ADDITIVE, 0, 0, material, 0, x, y, z, draw, arg);
+}
 
 /*
- *  Print Shader Log
+ *  Scene node functions, queue the visible nodes
  */
-void PrintShaderLog(int obj,char* file)
-{
-   int len=0;
-   glGetShaderiv(obj,GL_INFO_LOG_LENGTH,&len);
-   if (len>1)
-   {
-      int n=0;
-      char* buffer = (char *)malloc(len);
-      if (!buffer) Fatal("Cannot allocate %d bytes of text for shader log\n",len);
-      glGetShaderInfoLog(obj,len,&n,buffer);
-      fprintf(stderr,"%s:\n%s\n",file,buffer);
-      free(buffer);
+static void BatchNode(int k){
+   static_t* b = &staticBatch[k];
+   float specular[] = {b->specular, b->specular, b->specular, 1};
+   int material = RenderMaterial(specular, b->shininess, b->emission);
+   if (b->transparent)
+      SubmitTransparent(material, b->center[0], b->center[1], b->center[2], BatchDraw, k);
+   else
+      Submit(RENDER_OPAQUE, 0, b->texture, material, 0,
+             b->center[0], b->center[1], b->center[2], BatchDraw, k);
+}
+static void LightNode(int arg){
+   // lit fully by emission, so it shows white as it did unlit
+   float white[] = {1,1,1,1};
+   Submit(RENDER_OPAQUE, 0, 0, WhiteMaterial(1, white), 0,
+          lightPosition[0], lightPosition[1], lightPosition[2], LightDraw, 0);
+}
+static void BallNode(int arg){
+   Submit(RENDER_OPAQUE, 0, 0, WhiteMaterial(8, NULL), 0, ballx, bally, 0, BallDraw, 0);
+}
+static void CarNode(int arg){
+   Submit(RENDER_OPAQUE, 0, 0, WhiteMaterial(shiny, NULL), 0, 0, 2, 0, CarDraw, 0);
+}
+static void SkyNode(int arg){
+   Submit(RENDER_OPAQUE, 0, myTexture[1], WhiteMaterial(shiny, NULL), 0, 0, 0, 0, SkyDraw, 0);
+}
+static void CactusNode(int arg){
+   // the display list sets its own materials and texture
+   Submit(RENDER_OPAQUE, 0, 0, 0, 1, 4, 0, 0, CactusDraw, 0);
+}
+static void RockNode(int i){
+   Submit(RENDER_OPAQUE, 0, 0, WhiteMaterial(shiny, NULL), 0,
+          rockPosition[i].x, -dim*3, rockPosition[i].z, RockDraw, i);
+}
+static void TubeNode(int transparent){
+   if (transparent)
+      SubmitTransparent(WhiteMaterial(shiny, NULL), 0, 0, 2, TubeDraw, 1);
+   else
+      Submit(RENDER_OPAQUE, 0, 0, WhiteMaterial(shiny, NULL), 0, 0, 2, 0, TubeDraw, 0);
+}
+static void IslandNode(int arg){
+   Submit(RENDER_OPAQUE, 0, 0, WhiteMaterial(shiny, NULL), 0, 0, 0, 0, IslandDraw, 0);
+}
+static void WaterNode(int arg){
+   Submit(RENDER_OPAQUE, myShader, 0, WhiteMaterial(shiny, NULL), 0, 0, -5, 0, WaterDraw, 0);
+}
+static void LanternNode(int arg){
+   Submit(RENDER_OPAQUE, 0, 0, WhiteMaterial(8, NULL), 0, 0, 1.5, 0, LanternDraw, 0);
+}
+static void BalloonNode(int arg){
+   // the basket binds its own texture
+   Submit(RENDER_OPAQUE, 0, 0, WhiteMaterial(1, NULL), 1, 2, 4.2, 0, BalloonDraw, 0);
+}
+
+/*
+ *  Bounds of a quarter tube (TubeGeometry) placed like TubeFunction
+ *     the center line runs from (R,0,0) to (0,-R,0)
+ */
+static void TubeBounds(bounds_t* b, double x, double y, double z, double R, double tuber, double ph, double th){
+   float M[16];
+   double t = 1.4*tuber;
+   bounds_t local;
+   BoundsBox(&local, -t, -R-t, -t, R+t, t, t);
+   StaticMatrix(M, x, y, z, th, ph, 1);
+   BoundsTransform(b, &local, M);
+}
+
+/*
+ *  Place the point lights
+ *     the emissive car balls and the balloon come first,
+ *     then lanterns on a spiral around the machine
+ */
+static void PointLights(){
+   float yellow[] = {1, 1, 0, 1};
+   float orange[] = {1, 0.6, 0.2, 1};
+   for (int k = 0; k < MAXPOINT; k++){
+      pointlight_t* l = &pointLight[k];
+      if (k < 2){
+         // car at (0,2,0) with w=1, l=2, h=1 as in BakeStatic
+         l->position[0] = -2*5.0/12;
+         l->position[1] = 2-1.0/12;
+         l->position[2] = (k ? -1 : 1)*5.0/12;
+         l->radius = 2.5;
+         memcpy(l->color, yellow, sizeof(yellow));
+      }
+      else if (k == 2){
+         l->position[0] = 2;
+         l->position[1] = 4.2;
+         l->position[2] = 0;
+         l->radius = 4;
+         memcpy(l->color, orange, sizeof(orange));
+      }
+      else{
+         // golden angle spiral, spread over the heights of the machine
+         int j = k-3;
+         double a = j*137.508;
+         double r = 1.5 + 5*sqrt((j+0.5)/(MAXPOINT-3));
+         double hsv[] = {fmod(j*137.508, 360), 0.7, 1};
+         l->position[0] = r*Cos(a);
+         l->position[1] = -0.5 + 4*fmod(j*0.618034, 1);
+         l->position[2] = r*Sin(a);
+         l->radius = 1.5;
+         hsvToRgb(hsv, l->color);
+         l->color[3] = 1;
+      }
    }
-   glGetShaderiv(obj,GL_COMPILE_STATUS,&len);
-   if (!len) Fatal("Error compiling %s\n",file);
 }
 
 /*
- *  Print Program Log
+ *  Add an object node, drawn when the scene is not batched
+ *     and tested with occlusion queries if occlude is set
  */
-void PrintProgramLog(int obj)
-{
-   int len=0;
-   glGetProgramiv(obj,GL_INFO_LOG_LENGTH,&len);
-   if (len>1)
-   {
-      int n=0;
-      char* buffer = (char *)malloc(len);
-      if (!buffer) Fatal("Cannot allocate %d bytes of text for program log\n",len);
-      glGetProgramInfoLog(obj,len,&n,buffer);
-      fprintf(stderr,"%s\n",buffer);
+static void ObjectNode(const char* name, scenedraw_t draw, int arg, const bounds_t* bounds, int occlude){
+   int id = SceneAdd(name, draw, arg, -1, bounds);
+   SceneOcclusion(id, occlude);
+   objectNode[objectNodes++] = id;
+}
+
+/*
+ *  Build the scene graph
+ *     nodes are drawn in the order they are added, so transparent
+ *     objects go after the opaque ones
+ *     bounds are analytic for the procedural objects and come from the
+ *     loaded vertexes for the OBJ models
+ *     everything but the sky, the water and the small moving balls is
+ *     also occlusion tested; the sky and water enclose or span the view,
+ *     so their boxes are never hidden
+ */
+static void BuildScene(){
+   bounds_t b;
+   float M[16];
+   // moving objects, placed every frame
+   BoundsSphere(&b, 0, 0, 0, 0.1);
+   lightNode = SceneAdd("light", LightNode, 0, -1, &b);
+   ballNode = SceneAdd("ball", BallNode, 0, -1, &b);
+   // opaque static batches, placed by BakeStatic
+   BoundsSphere(&b, 0, 0, 0, 0);
+   for (int k = 0; k < NSTATIC; k++){
+      if (k == STATIC_TUBE) continue;
+      batchNode[k] = SceneAdd("batch", BatchNode, k, -1, &b);
+      SceneOcclusion(batchNode[k], k != STATIC_SKY);
+   }
+   // car body, wheels and wheel balls
+   double w = 1, l = 2, h = 1;
+   carXform = XformAdd(-1);
+   carBall[0] = XformAdd(carXform);
+   carBall[1] = XformAdd(carXform);
+   PlaceCar(carXform, carBall, 0, 2, 0, w, l, h, 0);
+   BoundsBox(&b, -l/2, 2-h/2-l/12, -7*w/12, l/2, 2+h/2, 7*w/12);
+   ObjectNode("car", CarNode, 0, &b, 1);
+   BoundsBox(&b, -3.5*dim, -3.5*dim, -3.5*dim, 3.5*dim, 3.5*dim, 3.5*dim);
+   ObjectNode("sky", SkyNode, 0, &b, 0);
+   StaticMatrix(M, 4, 0, 0, 0, 0, 1);
+   BoundsTransform(&b, &cactusBounds, M);
+   ObjectNode("cactus", CactusNode, 0, &b, 1);
+   for (int i = 0; i < rockNumbers; i++){
+      int style = rockPosition[i].style;
+      StaticMatrix(M, rockPosition[i].x, -dim*3, rockPosition[i].z, 0, 0, style != 3 ? 4 : 1);
+      BoundsTransform(&b, &rockBounds[style], M);
+      SceneOcclusion(SceneAdd("rock", RockNode, i, -1, &b), 1);
+   }
+   TubeBounds(&b, 0, 2, 0, 2, 0.2, 0, 0);
+   ObjectNode("tube", TubeNode, 0, &b, 1);
+   // island columns reach 2r*(layer-1) from the center plus their radius 2r/sqrt(3)
+   double layer = 5, r = 0.5, ih = 0.5;
+   double reach = 2*r*(layer-1) + 2*r/sqrt(3);
+   BoundsBox(&b, -reach, -ih*layer, -reach, reach, 0, reach);
+   ObjectNode("island", IslandNode, 0, &b, 1);
+   // water plane
+   double s = 3.5*dim*2;
+   BoundsBox(&b, -s, -5, -s, s, -5, s);
+   SceneAdd("water", WaterNode, 0, -1, &b);
+   // the balloon is widest at the top ring of its envelope
+   // and the basket hangs 1.4 times as low
+   double R = 1+40/cosh(2.75*(15*M_PI/180 + M_PI_2));
+   BoundsBox(&b, 2-R, 4.2-1.4*R*Cos(15), -R, 2+R, 4.2+R, R);
+   SceneOcclusion(SceneAdd("balloon", BalloonNode, 0, -1, &b), 1);
+   // transparent tube, batched or not
+   BoundsSphere(&b, 0, 0, 0, 0);
+   batchNode[STATIC_TUBE] = SceneAdd("batch", BatchNode, STATIC_TUBE, -1, &b);
+   SceneOcclusion(batchNode[STATIC_TUBE], 1);
+   TubeBounds(&b, 0, 0, 2, 2, 0.2, 90, 90);
+   ObjectNode("glass tube", TubeNode, 1, &b, 1);
+   // lantern markers, inside the spiral of PointLights
+   BoundsBox(&b, -6.6, -0.6, -6.6, 6.6, 3.6, 6.6);
+   lanternNode = SceneAdd("lanterns", LanternNode, 0, -1, &b);
+   PointLights();
+   // stress field, a group per row of 100 balls
+   int n = 100;
+   double x0 = (-n/2)*0.3-0.1, x1 = (n-1-n/2)*0.3+0.1;
+   BoundsBox(&b, x0, 6-0.1, x0, x1, 6+0.1, x1);
+   stressNode = SceneAdd("stress", NULL, 0, -1, &b);
+   for (int i = 0; i < n; i++){
+      double x = (i-n/2)*0.3;
+      BoundsBox(&b, x-0.1, 6-0.1, x0, x+0.1, 6+0.1, x1);
+      int row = SceneAdd("stress row", NULL, 0, stressNode, &b);
+      SceneOcclusion(row, 1);
+      for (int j = 0; j < n; j++){
+         BoundsSphere(&b, x, 6, (j-n/2)*0.3, 0.1);
+         SceneAdd("stress ball", StressBall, n*i+j, row, &b);
+      }
    }
-   glGetProgramiv(obj,GL_LINK_STATUS,&len);
-   if (!len) Fatal("Error linking program\n");
 }
 
 /*
- *  Create Shader
+ *  End the current phase of the frame and start the next, for the
+ *  benchmark timings, the frame statistics, the profiler and the trace
+ *  (NULL ends the last phase)
  */
-int CreateShader(GLenum type,char* file)
+static void Phase(const char* name)
 {
-   //  Create the shader
-   int shader = glCreateShader(type);
-   //  Load source code from file
-   char* source = ReadText(file);
-   glShaderSource(shader,1,(const char**)&source,NULL);
-   free(source);
-   //  Compile the shader
-   fprintf(stderr,"Compile %s\n",file);
-   glCompileShader(shader);
-   //  Check for errors
-   PrintShaderLog(shader,file);
-   //  Return name
-   return shader;
+   static int open = 0;
+   if (open){
+      ProfileEnd();
+      TraceEnd();
+   }
+   open = name != NULL;
+   FramePhase(name);
+   if (name){
+      BenchPhase(name);
+      ProfileBegin(name);
+      TraceBegin(name, NULL);
+   }
 }
 
 /*
- *  Create Shader Program
+ *  Print the frame statistics over the scene
  */
-int CreateShaderProg(char* VertFile,char* FragFile)
+static void DisplayStats(void)
 {
-   //  Create program
-   int prog = glCreateProgram();
-   //  Create and compile vertex shader
-   int vert = CreateShader(GL_VERTEX_SHADER,VertFile);
-   //  Create and compile fragment shader
-   int frag = CreateShader(GL_FRAGMENT_SHADER,FragFile);
-   //  Attach vertex shader
-   glAttachShader(prog,vert);
-   //  Attach fragment shader
-   glAttachShader(prog,frag);
-   //  Link program
-   glLinkProgram(prog);
-   //  Check for errors
-   PrintProgramLog(prog);
-   //  Return name
-   return prog;
+   int drawn, culled;
+   double cullTime;
+   SceneStats(&drawn, &culled, &cullTime);
+   glWindowPos2i(5,145);
+   Print("Culling(C)=%s drawn=%d culled=%d cull=%.3fms", culling?"On":"Off", drawn, culled, 1000*cullTime);
+   int skipped, queries, waiting;
+   double latency;
+   SceneOcclusionStats(&skipped, &queries, &waiting, &latency);
+   glWindowPos2i(5,165);
+   Print("Occlusion(O)=%s skipped=%d queries=%d waiting=%d latency=%.1f frames",
+         occlusion?"On":"Off", skipped, queries, waiting, latency);
+   int queued, changes, eliminated;
+   RenderStats(&queued, &changes, &eliminated);
+   glWindowPos2i(5,185);
+   Print("Render queue draws=%d state changes=%d eliminated=%d", queued, changes, eliminated);
+   glWindowPos2i(5,205);
+   Print("Transparency(W)=%s transparent pass=%.3fms", oit?"Weighted OIT":"Additive", RenderTransparentTime());
+   glWindowPos2i(5,225);
+   Print("Lighting(G)=%s", glsl?"GLSL":"Fixed");
+   int lit, refs, most, dropped;
+   double assign;
+   ClusterStats(&lit, &refs, &most, &dropped, &assign);
+   glWindowPos2i(5,245);
+   Print("Point lights(K)=%d cluster refs=%d max/cluster=%d dropped=%d assign=%.3fms",
+         lit, refs, most, dropped, 1000*assign);
+   int rebuilds;
+   double shadowCpu, shadowGpu;
+   ShadowStats(&rebuilds, &shadowCpu, &shadowGpu);
+   glWindowPos2i(5,265);
+   Print("Shadows(H)=%s static redraws=%d cpu=%.3fms gpu=%.3fms",
+         shadows?"On":"Off", rebuilds, 1000*shadowCpu, shadowGpu);
+   int xforms, xformUpdates;
+   XformStats(&xforms, &xformUpdates);
+   glWindowPos2i(5,285);
+   Print("Transforms=%d updated=%d", xforms, xformUpdates);
+   int streamBytes, stalls;
+   double stall;
+   StreamStats(&streamBytes, &stalls, &stall);
+   glWindowPos2i(5,305);
+   Print("Stream used=%dKB stalls=%d stall=%.3fms", streamBytes/1024, stalls, 1000*stall);
+   glWindowPos2i(5,325);
+   if (fpsTarget > 0)
+      Print("Pacing %s at %dHz cpu=%.0f%%", Animating()?"animating":"idle", fpsTarget, PaceCPU());
+   else
+      Print("Pacing %s unpaced cpu=%.0f%%", Animating()?"animating":"idle", PaceCPU());
+   int steps;
+   double stepMean, stepMax, simHz;
+   SimStats(&steps, &stepMean, &stepMax, &simHz);
+   glWindowPos2i(5,345);
+   Print("Simulation %.0fHz steps=%d step=%.4fms max=%.4fms", simHz, steps, 1000*stepMean, 1000*stepMax);
+   glWindowPos2i(5,365);
+   Print("Static batch %d objects in %d draws (%d triangles) island faces=%d of %d",
+         staticObjects, NSTATIC, staticTriangles, islandKept, islandFaces);
+   int hits, misses, evictions, cacheBytes;
+   GeoCacheStats(&hits, &misses, &evictions, &cacheBytes);
+   glWindowPos2i(5,85);
+   Print("Geometry cache hits=%d misses=%d evictions=%d size=%dKB", hits, misses, evictions, cacheBytes/1024);
+   InstanceStats(&instanceDraws, &instanceCount);
+   MeshStats(&sceneDraws);
+   sceneDraws += instanceDraws + listDraws;
+   listDraws = 0;
+   glWindowPos2i(5,125);
+   Print("LOD(L)=%s sphere triangles=%d (%d at inc=%d)", lod?"On":"Off", sphereTriangles, sphereFixed, inc);
+   sphereTriangles = sphereFixed = 0;
+   glWindowPos2i(5,105);
+   Print("Batching(B)=%s scene draws=%d", batching?"On":"Off", sceneDraws);
+   glWindowPos2i(5,65);
+   Print("Instancing(I)=%s Stress(X)=%s draws=%d instances=%d",
+         instancing?"On":"Off", stress?"On":"Off", instanceDraws, instanceCount);
+   double p50, p90, p99, max;
+   int over, hitches;
+   FrameStats(&p50, &p90, &p99, &max, &over, &hitches);
+   glWindowPos2i(5,45);
+   Print("Frame p50=%.1f p90=%.1f p99=%.1f max=%.1fms over=%d hitches=%d", p50, p90, p99, max, over, hitches);
+   //Print("Texture(T)=%s Mode(M)= %s",ntex?"On":"Off", mode?"Replace":"Modulate", distance,ylight);
+   glWindowPos2i(5,25);
+   Print("Ambient(A)=%d  Diffuse(D)=%d Specular(S)=%d Shininess(N)=%.0f",ambient,diffuse,specular,shiny);
 }
 
-
 /*
  *  OpenGL (GLUT) calls this routine to display the scene
  */
 void display()
 {
+   TraceBegin("display", NULL);
+   FrameBegin();
+   ProfileFrame();
+   ProfileBegin("display");
+   Phase("setup");
+   SimFrame();
+   //  Wait for the stream region of this frame to be free
+   StreamBegin();
    //  Erase the window and the depth buffer
    glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
    //  Enable Z-buffering in OpenGL
@@ -938,6 +1296,9 @@ void display()
    double Ey = +2*dim        *Sin(ph);
    double Ez = +2*dim*Cos(th)*Cos(ph);
    gluLookAt(Ex,Ey,Ez , 0,0,0 , 0,Cos(ph),0);
+   eye[0] = Ex;
+   eye[1] = Ey;
+   eye[2] = Ez;
 
 
 
@@ -951,9 +1312,7 @@ void display()
    float Specular[]  = {0.01*specular,0.01*specular,0.01*specular,1.0};
    //  Light position
    float Position[]  = {distance*Cos(zh),ylight,distance*Sin(zh),1.0};
-   //  Draw light position as ball (still no lighting here)
-   glColor3f(1,1,1);
-   ball(Position[0],Position[1],Position[2] , 0.1, 0);
+   memcpy(lightPosition,Position,sizeof(Position));
 
    //  OpenGL should normalize normal vectors
    glEnable(GL_NORMALIZE);
@@ -971,45 +1330,53 @@ void display()
    glLightfv(GL_LIGHT0,GL_DIFFUSE ,Diffuse);
    glLightfv(GL_LIGHT0,GL_SPECULAR,Specular);
    glLightfv(GL_LIGHT0,GL_POSITION,Position);
-
-   // count frame
-   Frames ++;
-   GLint t = glutGet(GLUT_ELAPSED_TIME);
-   if (t - T0 >= 1000) {
-      GLfloat seconds = (t - T0) / 1000.0;
-      fps = Frames / seconds;
-      // printf("%d frames in %6.3f seconds = %6.3f FPS\n", Frames, seconds, fps);
-      T0 = t;
-      Frames = 0;
-   }
-
-   // update the ball 30 fps
-   if( t - T1 >= 33){
-      T1 = t;
-      BallUpdate();
-   }
-   ball(ballx, bally, 0 , 0.2, 1);
-
-
-   //  Draw individual objects
-   drawCar(0,2,0, 1, 2, 1, 0);
-   Sky(3.5*dim);
-   // draw a water surface as big as the skybox
-   // water(0,-2,0,3.5*dim*2);
-   waterTest(0,-5,0,3.5*dim*2);
-
-
-   // display plant
-   DisplayModel(4, 0, 0, 0);
-   DisplayRocks(rockNumbers);
-
-   hotAirBalloon(2,4.2,0,40);
-   //Tube(double x, double y, double z, int steps, double R, double tuber){
-   TubeFunction(0, 2, 0, 2, 0.2, 180, 0, 0, 0);
-   DrawIsland(0, 0, 0, 5, 0.5, 0.5);
-
-   // *Transparent* tube
-   TubeFunction(0, 0, 2, 2, 0.2, 360, 90, 90, 1);
+   //  Same light for the per pixel lighting shader
+   Phase("lights");
+   float Global[4];
+   glGetFloatv(GL_LIGHT_MODEL_AMBIENT,Global);
+   LightingFrame(Position,Ambient,Diffuse,Specular,Global);
+   RenderLighting(glsl);
+   ClusterFrame(LightingProgram(), pointLight, glsl ? pointLights : 0);
+
+   Phase("scene");
+
+   //  Place the moving objects and pick the static set
+   bounds_t bounds;
+   BoundsSphere(&bounds, Position[0],Position[1],Position[2], 0.1);
+   SceneMove(lightNode, &bounds);
+   BoundsSphere(&bounds, ballx, bally, 0, 0.2);
+   SceneMove(ballNode, &bounds);
+   if ((batching || shadows) && staticDirty) BakeStatic();
+   for (int k = 0; k < NSTATIC; k++)
+      SceneEnable(batchNode[k], batching);
+   for (int k = 0; k < objectNodes; k++)
+      SceneEnable(objectNode[k], !batching);
+   SceneEnable(stressNode, stress);
+   SceneEnable(lanternNode, glsl && pointLights > 3);
+
+   //  Shadows of the static batches are redrawn once the light moves half a unit
+   Phase("shadows");
+   float target[] = {0, 1, 0};
+   if (glsl && shadows)
+      ShadowFrame(Position, target, 120, 0.5, 40, 0.5, ShadowStatic, ShadowDynamic);
+   else
+      ShadowOff();
+
+   //  World matrices of the transforms that changed
+   Phase("cull");
+   XformUpdate();
+
+   //  Cull against the view frustum and queue what is left, sorted by state
+   frustum_t frustum;
+   FrustumFromGL(&frustum);
+   SceneCull(culling ? &frustum : NULL);
+   Phase("draw");
+   RenderBegin();
+   SceneDraw();
+   if (stress) Submit(RENDER_OPAQUE, 0, 0, WhiteMaterial(8, NULL), 0, 0, 6, 0, StressDraw, 0);
+   RenderFlush();
+   //  Occlusion queries against this frame's depth, used next frame
+   SceneQuery();
    
    //  Draw axes - no lighting from here on
    glDisable(GL_LIGHTING);
@@ -1027,39 +1394,60 @@ void display()
       glVertex3d(0.0,0.0,0.0);
       glVertex3d(0.0,0.0,len);
       glEnd();
-      //  Label axes
-      glRasterPos3d(len,0.0,0.0);
-      Print("X");
-      glRasterPos3d(0.0,len,0.0);
-      Print("Y");
-      glRasterPos3d(0.0,0.0,len);
-      Print("Z");
+      //  Label axes (the GLUT fonts need a window)
+      if (!bench)
+      {
+         glRasterPos3d(len,0.0,0.0);
+         Print("X");
+         glRasterPos3d(0.0,len,0.0);
+         Print("Y");
+         glRasterPos3d(0.0,0.0,len);
+         Print("Z");
+      }
    }
 
    
-   //  Display parameters
-   glWindowPos2i(5,45);
-   Print("fps=%6.3f", fps);
-   //Print("Texture(T)=%s Mode(M)= %s",ntex?"On":"Off", mode?"Replace":"Modulate", distance,ylight);
-   glWindowPos2i(5,25);
-   Print("Ambient(A)=%d  Diffuse(D)=%d Specular(S)=%d Shininess(N)=%.0f",ambient,diffuse,specular,shiny);
+   //  Display parameters and the profile chart
+   Phase("hud");
+   if (!bench){
+      DisplayStats();
+      ProfileDraw();
+      PrintFlush();
+   }
 
    //  Render the scene and make it visible
-   ErrCheck("display");
+   Phase("finish");
+   //  Errors come from the debug callback, release builds skip the check
+   DebugFrame();
+   StreamEnd();
    glFlush();
-   glutSwapBuffers();
+   if (!bench) glutSwapBuffers();
+   Phase(NULL);
+   //  A static scene waits for input, which is not frame time
+   if (!Animating()) FrameReset();
+   ProfileEnd();
+   TraceEnd();
 }
 
 /*
- *  GLUT calls this routine when the window is resized
+ *  GLUT calls this routine when there is nothing else to do
+ *     frames are paced to the target rate while something animates;
+ *     once the scene is static the idle callback is removed, the
+ *     simulation thread parked and only input redraws it
  */
 void idle()
 {
-   //  Elapsed time in seconds
-   t = glutGet(GLUT_ELAPSED_TIME)/1000.0;
-   zh = fmod(90*t,360.0);
+   if (!Animating()){
+      glutIdleFunc(NULL);
+      SimActive(0);
+      FrameReset();
+      return;
+   }
+   TraceBegin("idle", NULL);
+   PaceWait();
    //  Tell GLUT it is necessary to redisplay the scene
    glutPostRedisplay();
+   TraceEnd();
 }
 
 /*
@@ -1124,9 +1512,53 @@ void key(unsigned char ch,int x,int y)
    else if (ch==']')
       ylight += 0.1;
    //reset
-   else if (ch=='r'){
-      ballx = bally = 2;
-      ballt = 0;
+   else if (ch=='r')
+      ballResets++;
+   //  Toggle instanced drawing
+   else if (ch == 'i' || ch == 'I'){
+      instancing = 1 - instancing;
+      InstanceMode(instancing);
+   }
+   //  Toggle the instancing stress test
+   else if (ch == 'x' || ch == 'X')
+      stress = 1 - stress;
+   //  Toggle static batching
+   else if (ch == 'b' || ch == 'B')
+      batching = 1 - batching;
+   //  Toggle sphere LOD
+   else if (ch == 'l' || ch == 'L')
+      lod = 1 - lod;
+   //  Toggle view frustum culling
+   else if (ch == 'c' || ch == 'C')
+      culling = 1 - culling;
+   //  Toggle weighted blended transparency
+   else if (ch == 'w' || ch == 'W')
+      oit = 1 - oit;
+   //  Toggle per pixel lighting
+   else if (ch == 'g' || ch == 'G')
+      glsl = 1 - glsl;
+   //  Toggle shadows
+   else if (ch == 'h' || ch == 'H')
+      shadows = 1 - shadows;
+   //  Start recording a timeline, then write it to the trace file
+   else if (ch == 'j' || ch == 'J'){
+      if (TraceOn())
+         fprintf(stderr, "Wrote %d trace events to %s\n", TraceDump(traceFile), traceFile);
+      else
+         TraceStart();
+   }
+   //  Toggle the profiler chart
+   else if (ch == 'p' || ch == 'P'){
+      profile = 1 - profile;
+      ProfileMode(profile);
+   }
+   //  Double the point lights, wrapping to none past the maximum
+   else if (ch == 'k' || ch == 'K')
+      pointLights = pointLights == 0 ? 1 : pointLights*2 > MAXPOINT ? 0 : pointLights*2;
+   //  Toggle occlusion culling
+   else if (ch == 'o' || ch == 'O'){
+      occlusion = 1 - occlusion;
+      SceneOcclusionMode(occlusion);
    }
      
    // //  Ambient level
@@ -1158,8 +1590,10 @@ void key(unsigned char ch,int x,int y)
    shiny = shininess<0 ? 0 : pow(2.0,shininess);
    //  Reproject
    Project(fov,asp,dim);
-   //  Animate if requested
-   glutIdleFunc(move?idle:NULL);
+   //  Animate while anything moves, parking the simulation otherwise
+   int on = Animating();
+   SimActive(on);
+   glutIdleFunc(on?idle:NULL);
    //  Tell GLUT it is necessary to redisplay the scene
    glutPostRedisplay();
 }
@@ -1171,6 +1605,7 @@ void reshape(int width,int height)
 {
    //  Ratio of the width to the height of the window
    asp = (height>0) ? (double)width/height : 1;
+   viewHeight = RES*height;
    //  Set the viewport to the entire window
    glViewport(0,0, RES*width,RES*height);
    //  Set projection
@@ -1178,51 +1613,164 @@ void reshape(int width,int height)
 }
 
 
+/*
+ *  Render bench frames offscreen along a scripted camera path and
+ *  print the frame times as JSON
+ *     the camera circles the island once while rising and falling,
+ *     and the clock advances exactly 1/BENCH_HZ seconds a frame
+ */
+static void Benchmark()
+{
+   reshape(600,400);
+   double wall = Timer();
+   clock_t cpu = clock();
+   for (benchFrame = 0; benchFrame < bench; benchFrame++){
+      th = 360*benchFrame/bench;
+      ph = 15 + 15*Sin(2*th);
+      Project(fov,asp,dim);
+      SimRun((double)benchFrame/BENCH_HZ);
+      BenchBegin();
+      display();
+      BenchEnd();
+   }
+   BenchReport(stdout);
+   fprintf(stderr, "Benchmark cpu=%.0f%%\n", 100*(double)(clock()-cpu)/CLOCKS_PER_SEC/(Timer()-wall));
+   int steps;
+   double stepMean, stepMax, simHz;
+   SimStats(&steps, &stepMean, &stepMax, &simHz);
+   fprintf(stderr, "Simulation %d steps at %.0fHz step=%.4fms max=%.4fms\n", steps, simHz, 1000*stepMean, 1000*stepMax);
+   if (TraceOn())
+      fprintf(stderr, "Wrote %d trace events to %s\n", TraceDump(traceFile), traceFile);
+}
+
 /*
  *  Start up GLUT and tell it what to do
  */
 int main(int argc,char* argv[])
 {
-   //  Initialize GLUT
-   glutInit(&argc,argv);
-   //  Request double buffered, true color window with Z buffering at 600x600
-   glutInitDisplayMode(GLUT_RGB | GLUT_DEPTH | GLUT_DOUBLE);
-   glutInitWindowSize(600,400);
-   glutCreateWindow("Ada Zhao Final Project");
+   double startup = Timer();
+   //  --bench N renders N frames offscreen with no window
+   //  --trace FILE records a timeline from the start into FILE
+   //  --hitch MS captures the frames around any frame slower than MS
+   //  --fps N paces animation to N frames a second (0 runs flat out)
+   double hitch = -1;
+   for (int k = 1; k < argc; k++){
+      if (!strcmp(argv[k],"--bench") && k+1 < argc && atoi(argv[k+1]) > 0)
+         bench = atoi(argv[++k]);
+      else if (!strcmp(argv[k],"--trace") && k+1 < argc){
+         traceFile = argv[++k];
+         TraceStart();
+      }
+      else if (!strcmp(argv[k],"--hitch") && k+1 < argc)
+         hitch = atof(argv[++k]);
+      else if (!strcmp(argv[k],"--fps") && k+1 < argc)
+         fpsTarget = atoi(argv[++k]);
+      else
+         Fatal("Usage: %s [--bench frames] [--trace file] [--hitch ms] [--fps n]\n",argv[0]);
+   }
+   PaceRate(fpsTarget);
+   //  The budget is one frame period; benchmarks only capture hitches when asked to
+   FrameBudget(1000.0/(fpsTarget > 0 ? fpsTarget : 60), hitch >= 0 ? hitch : bench ? 0 : 100);
+   TraceThread("main");
+   TraceBegin("init", NULL);
+   if (bench)
+      BenchContext(600,400);
+   else {
+      //  Initialize GLUT
+      glutInit(&argc,argv);
+      //  Request double buffered, true color window with Z buffering at 600x600
+      glutInitDisplayMode(GLUT_RGB | GLUT_DEPTH | GLUT_DOUBLE);
+      glutInitWindowSize(600,400);
+#if defined(GLDEBUG) && defined(GLUT_DEBUG)
+      glutInitContextFlags(GLUT_DEBUG);
+#endif
+      glutCreateWindow("Ada Zhao Final Project");
+      //  Set callbacks
+      glutDisplayFunc(display);
+      glutReshapeFunc(reshape);
+      glutSpecialFunc(special);
+      glutKeyboardFunc(key);
+      glutIdleFunc(idle);
+   }
 #ifdef USEGLEW
    //  Initialize GLEW
    if (glewInit()!=GLEW_OK) Fatal("Error initializing GLEW\n");
 #endif
-   //  Set callbacks
-   glutDisplayFunc(display);
-   glutReshapeFunc(reshape);
-   glutSpecialFunc(special);
-   glutKeyboardFunc(key);
-   glutIdleFunc(idle);
+   DebugInit();
    // load texture
    for (int k=0;k<4;k++)
    {
       myTexture[k] = LoadTexBMP(textureName[k]);
    }
 
-   // load models
-   for (int i = 0; i<4; i++){
-      myModels[i] = LoadOBJ(ModelNames[i]);
+   // load models, the cactus as a display list and the rocks as instanced meshes
+   myModels[0] = LoadOBJ(ModelNames[0]);
+   for (int i = 1; i<4; i++){
+      LoadOBJMesh(ModelNames[i], &rockMesh[i]);
+      rockInstance[i] = InstanceMesh(&rockMesh[i]);
    }
+   // unit ball for the wheel balls and the stress test
+   MeshInit(&ballMesh);
+   double shape[] = {inc};
+   Sphere(&ballMesh,shape);
+   MeshUpload(&ballMesh);
+   ballInstance = InstanceMesh(&ballMesh);
+   // precomputed sphere levels of detail
+   for (int k = 0; k < NLOD; k++){
+      double lodShape[] = {lodInc[k]};
+      MeshInit(&sphereLod[k]);
+      Sphere(&sphereLod[k], lodShape);
+      MeshUpload(&sphereLod[k]);
+      sphereLodInstance[k] = InstanceMesh(&sphereLod[k]);
+   }
+   // island, built on the first DrawIsland
+   MeshInit(&islandMesh);
+   // cactus geometry for the static batch
+   LoadOBJMesh(ModelNames[0], &cactusMesh);
+   // model space bounds of the models
+   BoundsMesh(&cactusBounds, &cactusMesh);
+   for (int i = 1; i<4; i++)
+      BoundsMesh(&rockBounds[i], &rockMesh[i]);
 
    // generate random shape and position for the rocks under the water
-   srand(time(0));
+   // (the same every run when benchmarking)
+   srand(bench ? 1 : time(0));
    for (int i = 0; i<rockNumbers; i++){
       rockPosition[i].x = ((double)rand()) / RAND_MAX * dim * 7 - dim*3.5;
       rockPosition[i].y = 0;
       rockPosition[i].z = ((double)rand()) / RAND_MAX * dim * 7 - dim*3.5;
       rockPosition[i].style = floor(((double)rand()) / RAND_MAX * 3+1);
    }
+   BuildScene();
    
-   myShader = CreateShaderProg("simple.vert","simple.frag");
+   // per frame data ring, 4MB a frame covers the stress field and a full cluster index
+   StreamInit(4<<20);
+   //  The HUD text is batched from a font atlas (GLUT draws the atlas)
+   if (!bench) PrintInit();
+   myShader = ShaderProgram("simple.vert","simple.frag",NULL);
+   InstanceInit(ShaderProgram("instance.vert","simple.frag",NULL));
+   oitShader = ShaderProgram("oit.vert","oit.frag",NULL);
+   OITInit(ShaderProgram("simple.vert","oitcomposite.frag",NULL));
+   LightingInit(ShaderProgram("pixel.vert","pixel.frag","SHADOWS POINT_LIGHTS"));
+   ShadowInit(LightingProgram(), 2048);
 
-   //  Pass control to GLUT so it can interact with the user
    ErrCheck("init");
+   TraceEnd();
+   int nprog, ncached;
+   double shaderTime;
+   ShaderStats(&nprog, &ncached, &shaderTime);
+   fprintf(stderr, "Startup %.0fms, %d shader programs in %.0fms (%d from the cache)\n",
+           1000*(Timer()-startup), nprog, 1000*shaderTime, ncached);
+   //  Everything that moves is stepped at SIM_HZ, on its own thread
+   //  unless benchmarking on the simulated clock
+   sim_t state = {0, zh/90, ballx, bally, 0, 0};
+   SimInit(SimUpdate, &state, sizeof(state), SIM_HZ);
+   if (bench){
+      Benchmark();
+      return 0;
+   }
+   SimStart();
+   //  Pass control to GLUT so it can interact with the user
    glutMainLoop();
    return 0;
 }
@@ -0,0 +1,214 @@
+//  CSCIx229 library
+//  Frame time percentiles and hitch capture
+#include "CSCIx229.h"
+
+//
+//  FrameBegin marks the start of each frame; a frame's time is the
+//  interval to the next FrameBegin, so it includes the swap and any
+//  wait.  FramePhase splits the frame into named phases as in the
+//  benchmark.
+//
+//  The last RING frames are kept in a ring together with a histogram
+//  of their times in BIN millisecond bins, updated as frames enter and
+//  leave the ring, so the percentiles are a walk over the bins rather
+//  than a sort.
+//
+//  A frame counts as over budget once it is more than JITTER past it, so
+//  a paced frame the scheduler or the spin on the clock releases a few
+//  microseconds late is not counted; the budget itself stays the period.
+//
+//  A frame slower than the hitch threshold starts a capture: AFTER
+//  frames later the BEFORE frames before it, the frame and the AFTER
+//  frames after it are written with their phase times to hitchN.json.
+//  Captures do not overlap and N wraps at MAXCAPTURE, so a slow machine
+//  does not fill the disk.
+//
+
+#define RING       1024  //  Frames kept
+#define BIN        0.1   //  Histogram bin width in milliseconds
+#define NBIN       2500  //  Bins, the last also counting slower frames
+#define MAXPHASE   16    //  Named phases
+#define BEFORE     30    //  Frames captured before a hitch
+#define AFTER      30    //  Frames captured after a hitch
+#define MAXCAPTURE 8     //  Capture files kept
+#define JITTER     0.25  //  Milliseconds a frame may run past the budget
+
+typedef struct
+{
+   double ms;               //  Frame time
+   float phase[MAXPHASE];   //  Phase times in milliseconds
+} frame_t;
+
+static double budget=1000.0/60;      //  Frame budget in milliseconds
+static double hitch=100;             //  Hitch threshold (0 for none)
+static frame_t ring[RING];           //  Last RING frames
+static long N=0;                     //  Frames recorded
+static int hist[NBIN];               //  Histogram of the ring
+static int over=0;                   //  Frames in the ring over budget
+static frame_t cur;                  //  Frame in progress
+static double t0=0,tp=0;             //  Start of the frame and of the phase
+static int phase=-1;                 //  Phase in progress (-1 for none)
+static const char* name[MAXPHASE];   //  Phase names in order of first use
+static int Nphase=0;
+static long pending=-1;              //  Hitch frame waiting to be captured
+static int captures=0;               //  Captures written
+
+//
+//  Set the frame budget and the hitch threshold in milliseconds
+//    a hitch threshold of 0 turns capturing off
+//
+void FrameBudget(double ms,double hitchms)
+{
+   budget = ms;
+   hitch  = hitchms;
+}
+
+//
+//  Histogram bin of a frame time
+//
+static int FrameBin(double ms)
+{
+   int k = ms/BIN;
+   return k<NBIN ? k : NBIN-1;
+}
+
+//
+//  Write the frames around the hitch at frame h
+//
+static void FrameCapture(long h)
+{
+   char file[64];
+   snprintf(file,sizeof(file),"hitch%d.json",captures++%MAXCAPTURE);
+   FILE* f = fopen(file,"w");
+   if (!f)
+   {
+      fprintf(stderr,"Cannot write hitch capture %s\n",file);
+      return;
+   }
+   long lo = h-BEFORE>0 ? h-BEFORE : 0;
+   fprintf(f,"{\n  \"hitch_frame\": %ld,\n  \"hitch_ms\": %.3f,\n  \"threshold_ms\": %.3f,\n  \"budget_ms\": %.3f,\n  \"frames\": [",
+           h,ring[h%RING].ms,hitch,budget);
+   for (long i=lo;i<N && i<=h+AFTER;i++)
+   {
+      frame_t* fr = ring+i%RING;
+      fprintf(f,"%s\n    {\"frame\": %ld, \"ms\": %.3f, \"phase_ms\": {",i>lo?",":"",i,fr->ms);
+      for (int k=0;k<Nphase;k++)
+         fprintf(f,"%s\"%s\": %.3f",k?", ":"",name[k],fr->phase[k]);
+      fprintf(f,"}}");
+   }
+   fprintf(f,"\n  ]\n}\n");
+   fclose(f);
+   fprintf(stderr,"%.1fms frame captured in %s\n",ring[h%RING].ms,file);
+}
+
+//
+//  End the phase in progress at time t
+//
+static void FrameClose(double t)
+{
+   if (phase>=0) cur.phase[phase] += 1000*(t-tp);
+   phase = -1;
+}
+
+//
+//  Start a frame, which ends the last one
+//
+void FrameBegin(void)
+{
+   double t = Timer();
+   if (t0>0)
+   {
+      FrameClose(t);
+      cur.ms = 1000*(t-t0);
+      //  Replace the oldest frame in the ring and the histogram
+      frame_t* fr = ring+N%RING;
+      if (N>=RING)
+      {
+         hist[FrameBin(fr->ms)]--;
+         if (fr->ms>budget+JITTER) over--;
+      }
+      *fr = cur;
+      hist[FrameBin(fr->ms)]++;
+      if (fr->ms>budget+JITTER) over++;
+      //  Capture hitches once the frames after them are in
+      if (hitch>0 && fr->ms>hitch && pending<0) pending = N;
+      N++;
+      if (pending>=0 && N>pending+AFTER)
+      {
+         FrameCapture(pending);
+         pending = -1;
+      }
+   }
+   memset(&cur,0,sizeof(cur));
+   t0 = t;
+}
+
+//
+//  Forget the frame in progress, so the next FrameBegin starts a frame
+//  without recording the time since this one, as after a pause
+//
+void FrameReset(void)
+{
+   memset(&cur,0,sizeof(cur));
+   phase = -1;
+   t0 = 0;
+}
+
+//
+//  End the phase in progress and start the phase called name
+//    NULL ends the phase, leaving the rest of the frame unassigned
+//    name must stay valid while the program runs
+//
+void FramePhase(const char* ph)
+{
+   if (t0==0) return;
+   double t = Timer();
+   FrameClose(t);
+   if (!ph) return;
+   for (phase=0;phase<Nphase && strcmp(name[phase],ph);phase++);
+   if (phase==Nphase)
+   {
+      if (Nphase>=MAXPHASE)
+      {
+         phase = -1;
+         return;
+      }
+      name[Nphase++] = ph;
+   }
+   tp = t;
+}
+
+//
+//  Frame time at fraction p of the frames in the ring (upper bin edge)
+//
+static double FramePercentile(double p,int n)
+{
+   int rank = (int)ceil(p*n);
+   int sum=0;
+   for (int k=0;k<NBIN;k++)
+   {
+      sum += hist[k];
+      if (sum>=rank) return BIN*(k+1);
+   }
+   return BIN*NBIN;
+}
+
+//
+//  Return the 50th, 90th and 99th percentile and the largest frame
+//  time of the frames in the ring, how many of them were over budget
+//  and the hitches captured so far
+//
+void FrameStats(double* p50,double* p90,double* p99,double* max,int* nover,int* nhitch)
+{
+   int n = N<RING ? N : RING;
+   *p50 = *p90 = *p99 = *max = 0;
+   *nover = over;
+   *nhitch = captures;
+   if (!n) return;
+   for (int k=0;k<n;k++)
+      if (ring[k].ms>*max) *max = ring[k].ms;
+   //  The upper bin edge can be past the slowest frame
+   *p50 = fmin(FramePercentile(0.50,n),*max);
+   *p90 = fmin(FramePercentile(0.90,n),*max);
+   *p99 = fmin(FramePercentile(0.99,n),*max);
+}
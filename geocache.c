@@ -0,0 +1,128 @@
+//  CSCIx229 library
+//  Procedural geometry cache
+#include "CSCIx229.h"
+
+//
+//  Procedural shapes are built into meshes through a build function that
+//  depends only on its shape parameters.  The cache is keyed on the build
+//  function and the parameter values: the first request builds and uploads
+//  the mesh, later requests reuse the buffer objects.  When the uploaded
+//  size exceeds the budget the least recently used meshes are evicted.
+//
+
+#define MAXGEO   256  //  Maximum number of cached meshes
+#define MAXPARAM 8    //  Maximum number of shape parameters
+
+typedef struct
+{
+   geobuild_t build;       //  Build function (NULL for a free slot)
+   int n;                  //  Number of parameters
+   double p[MAXPARAM];     //  Parameter values
+   mesh_t mesh;            //  Uploaded mesh
+   int bytes;              //  Size of the buffer objects
+   unsigned int used;      //  Last use
+} geo_t;
+
+static geo_t geo[MAXGEO];
+static unsigned int tick=0;            //  Use counter for LRU
+static int budget=8*1024*1024;         //  Memory budget in bytes
+static int bytes=0;                    //  Memory in use
+static int hits=0,misses=0,evicted=0;  //  Counters
+
+//
+//  Release a cache slot
+//
+static void GeoEvict(geo_t* g)
+{
+   bytes -= g->bytes;
+   MeshFree(&g->mesh);
+   g->build = NULL;
+   evicted++;
+}
+
+//
+//  Evict least recently used meshes until the budget is met
+//  keep is never evicted
+//
+static void GeoTrim(const geo_t* keep)
+{
+   while (bytes > budget)
+   {
+      geo_t* lru = NULL;
+      for (int k=0;k<MAXGEO;k++)
+         if (geo[k].build && geo+k!=keep && (!lru || geo[k].used<lru->used))
+            lru = geo+k;
+      if (!lru) break;
+      GeoEvict(lru);
+   }
+}
+
+//
+//  Return the mesh for build(p[0..n-1]), building it on a miss
+//  The mesh stays valid until the next GeoCache call
+//
+const mesh_t* GeoCache(geobuild_t build,int n,const double p[])
+{
+   if (n>MAXPARAM) Fatal("Too many geometry parameters %d\n",n);
+   tick++;
+   //  Look for a match
+   geo_t* g = NULL;
+   for (int k=0;k<MAXGEO;k++)
+   {
+      if (geo[k].build==build && geo[k].n==n && !memcmp(geo[k].p,p,n*sizeof(double)))
+      {
+         geo[k].used = tick;
+         hits++;
+         return &geo[k].mesh;
+      }
+      if (!geo[k].build && !g) g = geo+k;
+   }
+   misses++;
+   //  No free slot so evict the least recently used mesh
+   if (!g)
+   {
+      g = geo;
+      for (int k=1;k<MAXGEO;k++)
+         if (geo[k].used<g->used) g = geo+k;
+      GeoEvict(g);
+   }
+   //  Build and upload
+   g->build = build;
+   g->n     = n;
+   memcpy(g->p,p,n*sizeof(double));
+   g->used  = tick;
+   MeshInit(&g->mesh);
+   build(&g->mesh,p);
+   MeshUpload(&g->mesh);
+   g->bytes = g->mesh.nv*sizeof(vtx_t) + g->mesh.ni*sizeof(unsigned int);
+   //  Only the buffer objects are needed from here on
+   free(g->mesh.v);
+   free(g->mesh.idx);
+   g->mesh.v   = NULL;
+   g->mesh.idx = NULL;
+   g->mesh.nv  = g->mesh.mv = 0;
+   g->mesh.ni  = g->mesh.mi = 0;
+   bytes += g->bytes;
+   GeoTrim(g);
+   return &g->mesh;
+}
+
+//
+//  Set the memory budget in bytes
+//
+void GeoCacheBudget(int size)
+{
+   budget = size;
+   GeoTrim(NULL);
+}
+
+//
+//  Return hit, miss and eviction counts and the memory in use
+//
+void GeoCacheStats(int* nhit,int* nmiss,int* nevict,int* nbytes)
+{
+   *nhit   = hits;
+   *nmiss  = misses;
+   *nevict = evicted;
+   *nbytes = bytes;
+}
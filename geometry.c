@@ -0,0 +1,381 @@
+//  CSCIx229 library
+//  Procedural geometry generators of the final project scene
+#include "CSCIx229.h"
+
+//
+//  Each generator writes its geometry into a mesh (NULL draws it
+//  immediately).  Sphere, TubeGeometry and CarGeometry take their shape
+//  as parameters, so GeoCache can build them once per shape.
+//
+
+/*
+ *  Draw vertex in polar coordinates with normal, for Ball()
+ */
+static void Vertex(mesh_t* m,int th,int ph)
+{
+   float st,ct,sp,cp;
+   SinCosDeg(th,&st,&ct);
+   SinCosDeg(ph,&sp,&cp);
+   float x = st*cp;
+   float y = ct*cp;
+   float z =    sp;
+   //  For a sphere at the origin, the position
+   //  and normal vectors are the same
+   MeshNormal(m,x,y,z);
+   MeshVertex(m,x,y,z);
+}
+
+/*
+ *  Unit sphere
+ *     into mesh m (NULL draws it immediately)
+ *     p[0] is the angle increment
+ */
+void Sphere(mesh_t* m,const double p[])
+{
+   int inc = p[0];
+   //  Bands of latitude
+   for (int ph=-90;ph<90;ph+=inc)
+   {
+      MeshBegin(m,GL_QUAD_STRIP);
+      for (int th=0;th<=360;th+=2*inc)
+      {
+         Vertex(m,th,ph);
+         Vertex(m,th,ph+inc);
+      }
+      MeshEnd(m);
+   }
+}
+
+#define TUBE_STEP 9  // degrees between the rings of the tube
+
+/*
+Geometry of a 1/4 circle tube at the origin into mesh m
+p[0] = R the curve, p[1] = tuber the tube radius
+p[2] = tubeDegree defines whether its a whole tube or only the bottom part
+p[3] = tubeColor
+*/
+void TubeGeometry(mesh_t* m, const double p[]){
+   double R = p[0];
+   double tuber = p[1];
+   int tubeDegree = p[2];
+   int tubeColor = p[3];
+
+   float tubeColorArray[2][4] = {{1, 1, 1, 1}, {1, 0, 1, 0.3}};
+
+   MeshColor(m,tubeColorArray[tubeColor][0], tubeColorArray[tubeColor][1],tubeColorArray[tubeColor][2],tubeColorArray[tubeColor][3]);
+   // frame at each step along the curve: the tangent dv, the axis of the
+   // curve perpendicular and the binormal cross, made in one batch
+   int steps = 90/TUBE_STEP;
+   float dv[3*(90/TUBE_STEP+1)], perpendicular[3*(90/TUBE_STEP+1)], cross_product[3*(90/TUBE_STEP+1)];
+   float tubex[90/TUBE_STEP+1], tubey[90/TUBE_STEP+1];
+   for (int k = 0; k <= steps; k++){
+      float s, c;
+      SinCosDeg(k*TUBE_STEP, &s, &c);
+      tubex[k] = R*c;
+      tubey[k] = -R*s;
+      dv[3*k] = tubey[k];
+      dv[3*k+1] = -tubex[k];
+      dv[3*k+2] = 0;
+      perpendicular[3*k] = perpendicular[3*k+1] = 0;
+      perpendicular[3*k+2] = 1;
+   }
+   Vec3NormalizeArray(dv, steps+1);
+   Vec3CrossArray(cross_product, dv, perpendicular, steps+1);
+   Vec3NormalizeArray(cross_product, steps+1);
+
+   // inner and outer surface of the tube
+   for(int flip = 1; flip < 3; flip ++){
+      // outter loop = 1.4*tuber
+      float localtuber = (1+(flip-1)*0.4)*tuber;
+      float normalCalc = 2*flip-3;
+      for(int k = 0; k < steps; k++){
+         MeshBegin(m,GL_QUAD_STRIP);
+         for(int j = 0; j >= -tubeDegree; j-=30){
+            float sj, cj;
+            SinCosDeg(j, &sj, &cj);
+            // the circle of the tube at both ends of the step
+            for (int e = k; e <= k+1; e++){
+               const float* d = dv+3*e;
+               const float* p = perpendicular+3*e;
+               const float* c = cross_product+3*e;
+               float dot_product = Vec3Dot(d, p);
+               float b_rotate[3];
+               for (int i = 0; i < 3; i++)
+                  b_rotate[i] = p[i]*cj + c[i]*sj + d[i]*dot_product*(1-cj);
+               MeshNormal(m,b_rotate[0]*normalCalc,b_rotate[1]*normalCalc,b_rotate[2]*normalCalc);
+               MeshVertex(m,tubex[e]+b_rotate[0]*localtuber,tubey[e]+b_rotate[1]*localtuber,b_rotate[2]*localtuber);
+            }
+         }
+         MeshEnd(m);
+      }
+   }
+   if(tubeColor == 0) MeshColor(m,1, 0.95, 0.509, 1);
+   // side
+   if(tubeDegree != 360){    
+      for (int j = 0; j < 2; j++){
+         MeshBegin(m,GL_QUAD_STRIP);
+         for(int k = 0; k <= steps; k++){
+            MeshNormal(m,-tubex[k]/R, -tubey[k]/R, 0);
+            MeshVertex(m,tubex[k], tubey[k], (j*2-1)*tuber);
+            MeshVertex(m,tubex[k], tubey[k], (j*2-1)*tuber*1.4);
+         }
+         MeshEnd(m);
+      }
+   }
+   
+
+   // top and bottom
+   MeshBegin(m,GL_QUAD_STRIP);
+   MeshNormal(m,0, 1, 0);
+   for(int j = 0; j <= tubeDegree; j+=30){
+      float sj, cj;
+      SinCosDeg(j, &sj, &cj);
+      MeshVertex(m,R+tuber*sj, 0, tuber*cj);
+      MeshVertex(m,R+tuber*sj*1.4, 0, tuber*cj*1.4);
+   }
+   MeshEnd(m);
+
+   MeshBegin(m,GL_QUAD_STRIP);
+   MeshNormal(m,-1, 0, 0);
+   for(int j = 0; j >= -tubeDegree; j-=30){
+      float sj, cj;
+      SinCosDeg(j, &sj, &cj);
+      MeshVertex(m,0, -R+tuber*sj, tuber*cj);
+      MeshVertex(m,0, -R+tuber*sj*1.4, tuber*cj*1.4);
+   }
+   MeshEnd(m);
+}
+
+/*
+ *  Car body and wheels at the origin into mesh m
+ *     p[0] = w width, p[1] = l length, p[2] = h height
+ */
+void CarGeometry(mesh_t* m, const double p[])
+{
+   double w = p[0];
+   double l = p[1];
+   double h = p[2];
+
+   MeshBegin(m,GL_QUADS);
+
+   // wrap around the car
+   MeshColor(m,1, 0, 0, 1);
+   calcNormalMesh(m,-l/2, -h/2, w/2, -l/2, -h/2, -w/2, -5*l/12, 0, w/2);
+   MeshVertex(m,-l/2, -h/2, w/2);
+   MeshVertex(m,-l/2, -h/2, -w/2);
+   MeshVertex(m,-5*l/12, 0, -w/2);
+   MeshVertex(m,-5*l/12, 0, w/2);
+
+   calcNormalMesh(m,-5*l/12, 0, w/2, -5*l/12, 0, -w/2, -l/4, 0, w/2);
+   MeshVertex(m,-5*l/12, 0, w/2);
+   MeshVertex(m,-5*l/12, 0, -w/2);
+   MeshVertex(m,-l/4, 0, -w/2);
+   MeshVertex(m,-l/4, 0, w/2);
+
+   // （glass color）
+   MeshColor(m,1, 1, 1, 1);
+   calcNormalMesh(m,-l/4, 0, w/2, -l/4, 0, -w/2, -l/6, h/2, w/2);
+   MeshVertex(m,-l/4, 0, w/2);
+   MeshVertex(m,-l/4, 0, -w/2);
+   MeshVertex(m,-l/6, h/2, -w/2);
+   MeshVertex(m,-l/6, h/2, w/2);
+
+   MeshColor(m,1, 0, 0, 1);
+   calcNormalMesh(m,-l/6, h/2, w/2, -l/6, h/2, -w/2, l/6, h/2, w/2);
+   MeshVertex(m,-l/6, h/2, w/2);
+   MeshVertex(m,-l/6, h/2, -w/2);
+   MeshVertex(m,l/6, h/2, -w/2);
+   MeshVertex(m,l/6, h/2, w/2);
+
+   calcNormalMesh(m,l/6, h/2, w/2, l/6, h/2, -w/2, l/4, 0, w/2);
+   MeshVertex(m,l/6, h/2, w/2);
+   MeshVertex(m,l/6, h/2, -w/2);
+   MeshVertex(m,l/4, 0, -w/2);
+   MeshVertex(m,l/4, 0, w/2);
+
+   calcNormalMesh(m,l/4, 0, w/2, l/4, 0, -w/2, 5*l/12, 0, w/2);
+   MeshVertex(m,l/4, 0, w/2);
+   MeshVertex(m,l/4, 0, -w/2);
+   MeshVertex(m,5*l/12, 0, -w/2);
+   MeshVertex(m,5*l/12, 0, w/2);
+
+   calcNormalMesh(m,5*l/12, 0, w/2, 5*l/12, 0, -w/2, l/2, -h/2, w/2);
+   MeshVertex(m,5*l/12, 0, w/2);
+   MeshVertex(m,5*l/12, 0, -w/2);
+   MeshVertex(m,l/2, -h/2, -w/2);
+   MeshVertex(m,l/2, -h/2, w/2);
+
+   calcNormalMesh(m,l/2, -h/2, w/2, l/2, -h/2, -w/2, -l/2, -h/2, w/2);
+   MeshVertex(m,l/2, -h/2, w/2);
+   MeshVertex(m,l/2, -h/2, -w/2);
+   MeshVertex(m,-l/2, -h/2, -w/2);
+   MeshVertex(m,-l/2, -h/2, w/2);
+
+   MeshEnd(m);
+
+   // side
+   float tempW = w/2;
+   for (int i=0; i<2;i++){
+
+      MeshNormal(m,0, 0, tempW);
+
+      MeshBegin(m,GL_QUAD_STRIP);
+      MeshColor(m,1, 0.4, 0.4, 1);
+
+      MeshVertex(m,-l/2, -h/2, tempW);
+      MeshVertex(m,-5*l/12, 0, tempW);
+      
+      MeshVertex(m,-l/4, -h/2, tempW);
+      MeshVertex(m,-l/4, 0, tempW);
+
+      MeshVertex(m,-l/6, -h/2, tempW);
+      MeshVertex(m,-l/6, h/2, tempW);
+
+      MeshVertex(m,l/6, -h/2, tempW);
+      MeshVertex(m,l/6, h/2, tempW);
+
+      MeshVertex(m,l/4, -h/2, tempW);
+      MeshVertex(m,l/4, 0, tempW);
+
+      MeshVertex(m,l/2, -h/2, tempW);
+      MeshVertex(m,5*l/12, 0, tempW);
+      MeshEnd(m);
+
+      // draw the other side
+      tempW *= -1;
+   }
+   //  wheels
+   MeshColor(m,1,1,0, 1);
+   // the x and z position of the side face of all wheels
+   float const wheelCenter [8][2] = 
+   {
+    {l/4, 7*w/12},
+    {l/4, 5*w/12},
+    {l/4, -5*w/12},
+    {l/4, -7*w/12},
+    {-l/4, 7*w/12},
+    {-l/4, 5*w/12},
+    {-l/4, -5*w/12},
+    {-l/4, -7*w/12}
+   };
+   float r = l/12;
+   for (int i = 0; i < 8; i++){
+      MeshBegin(m,GL_TRIANGLE_FAN);
+      MeshNormal(m,0, 0, 1-i%2*2);
+      // check it
+
+      MeshVertex(m,wheelCenter[i][0], -h/2, wheelCenter[i][1]);
+      for (int th=0;th<=360;th+=45)
+         MeshVertex(m,wheelCenter[i][0]+Cos(th)*r, -h/2+Sin(th)*r,wheelCenter[i][1]);
+      MeshEnd(m);
+   }
+   
+   for (int i = 0; i < 8; i+=2){
+      MeshBegin(m,GL_QUAD_STRIP);
+      for (int th=0;th<=360;th+=45){
+         MeshNormal(m,Cos(th), Sin(th), 0);
+         MeshVertex(m,wheelCenter[i][0]+Cos(th)*r, -h/2+Sin(th)*r,wheelCenter[i][1]);
+         MeshVertex(m,wheelCenter[i+1][0]+Cos(th)*r, -h/2+Sin(th)*r,wheelCenter[i+1][1]);
+      }
+      MeshNormal(m,1, 0, 0);
+      MeshVertex(m,wheelCenter[i][0]+Cos(0)*r, -h/2+Sin(0)*r,wheelCenter[i][1]);
+      MeshVertex(m,wheelCenter[i+1][0]+Cos(0)*r, -h/2+Sin(0)*r,wheelCenter[i+1][1]);
+      MeshEnd(m);
+   }
+}
+
+// hexagonal column with radius r and height h at x, y, z
+// into mesh m (NULL draws it immediately)
+// faces in the hide mask are left out
+// returns the number of faces emitted
+// if the hexagonal is the top layer, it will have some grass on it
+int HexColumn(mesh_t* m, double x, double y, double z, double r, double h, int top, int hide){
+   float lightbrown[]  = {0.91,0.78,0.6};
+   float darkbrown[]  = {0.796,0.58,0.376};
+   float lightgreen[]  = {0.631,0.8,0.227};
+   float darkgreen[]  = {0.039,0.545,0.329};
+   int faces = 0;
+   // corners every 60 degrees from 0 and side normals between them
+   float c[7], s[7], nc[6], ns[6];
+   for (int k = 0; k <= 6; k++){
+      SinCosDeg(60*k, &s[k], &c[k]);
+      if (k < 6) SinCosDeg(60*k+30, &ns[k], &nc[k]);
+   }
+
+   if (!(hide & HEX_TOP)){
+      MeshBegin(m,GL_TRIANGLE_FAN);
+      MeshColor(m,lightbrown[0], lightbrown[1], lightbrown[2], 1);
+      if(top){
+         MeshColor(m,lightgreen[0], lightgreen[1], lightgreen[2], 1);
+      }
+      MeshNormal(m,0, 1, 0);
+      MeshVertex(m,x, y, z);
+      for (int i = 0; i <= 360; i += 60){
+         MeshVertex(m,x+r*c[i/60], y, z+r*s[i/60]);
+      }
+      MeshEnd(m);
+      faces++;
+   }
+
+   if (!(hide & HEX_BOTTOM)){
+      MeshBegin(m,GL_TRIANGLE_FAN);
+      MeshColor(m,darkbrown[0], darkbrown[1], darkbrown[2], 1);
+      MeshNormal(m,0, -1, 0);
+      MeshVertex(m,x, y-h, z);
+      for (int i = 0; i <= 360; i += 60){
+         MeshVertex(m,x+r*c[i/60], y-h, z+r*s[i/60]);
+      }
+      MeshEnd(m);
+      faces++;
+   }
+
+   if (top){
+      MeshBegin(m,GL_QUADS);
+      for (int i = 0; i < 360; i += 60){
+         if (hide & (HEX_SIDE<<(i/60))) continue;
+         MeshNormal(m,nc[i/60], 0, ns[i/60]);
+         MeshColor(m,lightbrown[0], lightbrown[1], lightbrown[2], 1);
+         MeshVertex(m,x+r*c[i/60], y-h/2, z+r*s[i/60]);
+         MeshColor(m,darkbrown[0], darkbrown[1], darkbrown[2], 1);
+         MeshVertex(m,x+r*c[i/60], y-h, z+r*s[i/60]);
+         MeshVertex(m,x+r*c[i/60+1], y-h, z+r*s[i/60+1]);
+         MeshColor(m,lightbrown[0], lightbrown[1], lightbrown[2], 1);
+         MeshVertex(m,x+r*c[i/60+1], y-h/2, z+r*s[i/60+1]);
+         faces++;
+      }
+      MeshEnd(m);
+
+      MeshBegin(m,GL_QUADS);
+      for (int i = 0; i < 360; i += 60){
+         if (hide & (HEX_SIDE<<(i/60))) continue;
+         MeshNormal(m,nc[i/60], 0, ns[i/60]);
+         MeshColor(m,lightgreen[0], lightgreen[1], lightgreen[2], 1);
+         MeshVertex(m,x+r*c[i/60], y, z+r*s[i/60]);
+         MeshColor(m,darkgreen[0], darkgreen[1], darkgreen[2], 1);
+         MeshVertex(m,x+r*c[i/60], y-h/2, z+r*s[i/60]);
+         MeshVertex(m,x+r*c[i/60+1], y-h/2, z+r*s[i/60+1]);
+         MeshColor(m,lightgreen[0], lightgreen[1], lightgreen[2], 1);
+         MeshVertex(m,x+r*c[i/60+1], y, z+r*s[i/60+1]);
+         faces++;
+      }
+      MeshEnd(m);
+
+   }else{
+      MeshBegin(m,GL_QUADS);
+      for (int i = 0; i < 360; i += 60){
+         if (hide & (HEX_SIDE<<(i/60))) continue;
+         MeshColor(m,lightbrown[0], lightbrown[1], lightbrown[2], 1);
+         MeshNormal(m,nc[i/60], 0, ns[i/60]);
+         MeshVertex(m,x+r*c[i/60], y, z+r*s[i/60]);
+         MeshColor(m,darkbrown[0], darkbrown[1], darkbrown[2], 1);
+         MeshVertex(m,x+r*c[i/60], y-h, z+r*s[i/60]);
+         MeshVertex(m,x+r*c[i/60+1], y-h, z+r*s[i/60+1]);
+         MeshColor(m,lightbrown[0], lightbrown[1], lightbrown[2], 1);
+         MeshVertex(m,x+r*c[i/60+1], y, z+r*s[i/60+1]);
+         faces++;
+      }
+      MeshEnd(m);
+
+   }
+   return faces;
+}
@@ -15,20 +15,25 @@ void calcNormal(double ax, double ay, double az,
                double bx, double by, double bz, 
                double cx, double cy, double cz)
 {
-   //  Planar vector 0
-   float dx0 = bx-ax;
-   float dy0 = by-ay;
-   float dz0 = bz-az;
-   //  Planar vector 1
-   float dx1 = cx-ax;
-   float dy1 = cy-ay;
-   float dz1 = cz-az;
-   //  Normal = d1 * d0
-   float Nx = dy1*dz0 - dy0*dz1;
-   float Ny = dz1*dx0 - dz0*dx1;
-   float Nz = dx1*dy0 - dx0*dy1;
-
-   glNormal3f(Nx,Ny,Nz);
+   calcNormalMesh(NULL,ax,ay,az,bx,by,bz,cx,cy,cz);
+}
+
+/*
+same as calcNormal, but the normal goes into mesh m (NULL for glNormal)
+*/
+void calcNormalMesh(mesh_t* m,
+               double ax, double ay, double az,
+               double bx, double by, double bz,
+               double cx, double cy, double cz)
+{
+   //  Planar vectors
+   float d0[] = {bx-ax, by-ay, bz-az};
+   float d1[] = {cx-ax, cy-ay, cz-az};
+   //  Normal = d1 x d0
+   float N[3];
+   Vec3Cross(N,d1,d0);
+
+   MeshNormal(m,N[0],N[1],N[2]);
 }
 
 
@@ -39,14 +44,44 @@ void calcTextCord( double x, double y)
    glTexCoord2f(x/512,1-y/512);
 }
 
-void calcNormal2V(double X0, double Y0, double Z0, double X1, double Y1, double Z1){
-   double X2 = Y0*Z1-Y1*Z0;
-   double Y2 = Z0*X1-Z1*X0;
-   double Z2 = X0*Y1-X1*Y0;
-   glNormal3f(X2,Y2,Z2);
-
-
-}
+/*
+ *  Convert hsv color to rgb
+ */
+void hsvToRgb(double hsv[3], GLfloat rgb[3]) {
+    double c, x, m;
+    double h = hsv[0], s = hsv[1], v = hsv[2];
 
+    c = v * s;
+    x = c * (1 - fabs(fmod(h / 60.0, 2) - 1));
+    m = v - c;
 
+    if (h >= 0 && h < 60) {
+        rgb[0] = c;
+        rgb[1] = x;
+        rgb[2] = 0;
+    } else if (h >= 60 && h < 120) {
+        rgb[0] = x;
+        rgb[1] = c;
+        rgb[2] = 0;
+    } else if (h >= 120 && h < 180) {
+        rgb[0] = 0;
+        rgb[1] = c;
+        rgb[2] = x;
+    } else if (h >= 180 && h < 240) {
+        rgb[0] = 0;
+        rgb[1] = x;
+        rgb[2] = c;
+    } else if (h >= 240 && h < 300) {
+        rgb[0] = x;
+        rgb[1] = 0;
+        rgb[2] = c;
+    } else {
+        rgb[0] = c;
+        rgb[1] = 0;
+        rgb[2] = x;
+    }
 
+    rgb[0] += m;
+    rgb[1] += m;
+    rgb[2] += m;
+}
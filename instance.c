@@ -0,0 +1,244 @@
+//  CSCIx229 library
+//  Instanced rendering of repeated meshes
+#include "CSCIx229.h"
+
+//
+//  Each registered mesh owns a batch.  InstanceAdd appends a transform,
+//  color and emission to the batch, and InstanceFlush writes all of them
+//  to the stream ring and issues one glDrawElementsInstanced per mesh
+//  that reads them from there.  InstanceFlushMesh draws the batch of one
+//  mesh only, so a caller does not draw instances others queued with
+//  their own material.  With instancing switched off the same queue is
+//  drawn one instance at a time through the fixed function pipeline for
+//  comparison.
+//
+//  Both ways light with the specular and shininess of the render queue
+//  material the draw was submitted with, the instance supplying its own
+//  color and emission.
+//
+
+#define MAXBATCH 64  //  Maximum number of instanced meshes
+#define NFLOAT   24  //  Floats per instance (matrix, color, emission)
+
+typedef struct
+{
+   const mesh_t* mesh;  //  Mesh drawn by this batch
+   int n,max;           //  Instances queued and allocated
+   float* data;         //  Queued instance data
+} batch_t;
+
+static batch_t batch[MAXBATCH];
+static int Nbatch=0;
+
+static int shader=-1;             //  Instancing shader
+static int Model,Color,Emission;  //  Attribute locations
+static int Material;              //  Material uniform location
+static int instanced=1;           //  Use glDrawElementsInstanced
+static int draws=0,count=0;       //  Draw calls and instances this frame
+
+//
+//  Set the shader used for instanced draws
+//
+void InstanceInit(int prog)
+{
+   shader   = prog;
+   Model    = glGetAttribLocation(prog,"Model");
+   Color    = glGetAttribLocation(prog,"Color");
+   Emission = glGetAttribLocation(prog,"Emission");
+   if (Model<0 || Color<0 || Emission<0) Fatal("Instancing shader is missing attributes\n");
+   Material = glGetUniformLocation(prog,"Material");
+   //  Shares the lighting materials buffer
+   glUniformBlockBinding(prog,glGetUniformBlockIndex(prog,"Materials"),1);
+}
+
+//
+//  Register an uploaded mesh and return its batch number
+//
+int InstanceMesh(const mesh_t* mesh)
+{
+   if (Nbatch>=MAXBATCH) Fatal("Too many instanced meshes\n");
+   batch_t* b = batch+Nbatch;
+   memset(b,0,sizeof(batch_t));
+   b->mesh = mesh;
+   return Nbatch++;
+}
+
+//
+//  Queue one instance of a mesh
+//    M is a column major model matrix
+//    emission may be NULL for none
+//
+void InstanceAdd(int id,const float M[16],const float color[4],const float emission[4])
+{
+   static const float black[] = {0,0,0,1};
+   if (id<0 || id>=Nbatch) Fatal("Invalid instance batch %d\n",id);
+   batch_t* b = batch+id;
+   if (b->n >= b->max)
+   {
+      b->max = b->max ? 2*b->max : 256;
+      b->data = (float*)realloc(b->data,b->max*NFLOAT*sizeof(float));
+      if (!b->data) Fatal("Cannot allocate %d instances\n",b->max);
+   }
+   float* d = b->data + NFLOAT*b->n++;
+   memcpy(d,M,16*sizeof(float));
+   memcpy(d+16,color,4*sizeof(float));
+   memcpy(d+20,emission?emission:black,4*sizeof(float));
+}
+
+//
+//  Point a per instance attribute at the instance data
+//    base is the byte offset of the data in the stream buffer
+//
+static void InstanceAttrib(int loc,int base,int offset)
+{
+   glEnableVertexAttribArray(loc);
+   glVertexAttribPointer(loc,4,GL_FLOAT,GL_FALSE,NFLOAT*sizeof(float),(void*)(size_t)(base+offset*sizeof(float)));
+   glVertexAttribDivisor(loc,1);
+}
+
+//
+//  Undo InstanceAttrib
+//
+static void InstanceDetach(int loc)
+{
+   glVertexAttribDivisor(loc,0);
+   glDisableVertexAttribArray(loc);
+}
+
+//
+//  Draw queued instances one at a time
+//  Fixed function can't modulate vertex colors by a second color,
+//  so an instance color other than white replaces the vertex colors
+//
+static void InstanceSingle(batch_t* b)
+{
+   MeshBind(b->mesh);
+   glPushAttrib(GL_CURRENT_BIT|GL_LIGHTING_BIT);
+   RenderMaterialFixed(RenderDrawMaterial());
+   for (int k=0;k<b->n;k++)
+   {
+      float* d = b->data + NFLOAT*k;
+      int white = d[16]==1 && d[17]==1 && d[18]==1 && d[19]==1;
+      if (white && b->mesh->color)
+         glEnableClientState(GL_COLOR_ARRAY);
+      else
+      {
+         glDisableClientState(GL_COLOR_ARRAY);
+         glColor4fv(d+16);
+      }
+      glMaterialfv(GL_FRONT,GL_EMISSION,d+20);
+      glPushMatrix();
+      glMultMatrixf(d);
+      glDrawElements(GL_TRIANGLES,b->mesh->count,GL_UNSIGNED_INT,(void*)0);
+      glPopMatrix();
+      draws++;
+   }
+   glPopAttrib();
+   MeshUnbind();
+}
+
+//
+//  Draw and empty one batch
+//
+static void InstanceBatch(batch_t* b)
+{
+   if (!b->n) return;
+   count += b->n;
+   //  Fixed function path
+   if (!instanced || shader<0)
+   {
+      glUseProgram(0);
+      InstanceSingle(b);
+      b->n = 0;
+      return;
+   }
+   //  Stream instance data
+   int base = StreamWrite(b->data,b->n*NFLOAT*sizeof(float));
+   //  Mesh arrays then instance arrays
+   //  Meshes without vertex colors are modulated from white
+   glUseProgram(shader);
+   //  Draws outside the render queue use the first material
+   int m = RenderDrawMaterial();
+   glUniform1i(Material,m>0 ? m-1 : 0);
+   glPushAttrib(GL_CURRENT_BIT);
+   glColor4f(1,1,1,1);
+   MeshBind(b->mesh);
+   glBindBuffer(GL_ARRAY_BUFFER,StreamBuffer());
+   for (int k=0;k<4;k++)
+      InstanceAttrib(Model+k,base,4*k);
+   InstanceAttrib(Color,base,16);
+   InstanceAttrib(Emission,base,20);
+   glDrawElementsInstanced(GL_TRIANGLES,b->mesh->count,GL_UNSIGNED_INT,(void*)0,b->n);
+   for (int k=0;k<4;k++)
+      InstanceDetach(Model+k);
+   InstanceDetach(Color);
+   InstanceDetach(Emission);
+   MeshUnbind();
+   glPopAttrib();
+   draws++;
+   b->n = 0;
+}
+
+//
+//  Draw all queued instances with the current modelview matrix
+//  and empty the queues
+//  Instances are lit by the instance shader or fixed function, and the
+//  program bound before is bound again afterwards
+//
+void InstanceFlush(void)
+{
+   int prog;
+   glGetIntegerv(GL_CURRENT_PROGRAM,&prog);
+   for (int i=0;i<Nbatch;i++)
+      InstanceBatch(batch+i);
+   glUseProgram(prog);
+}
+
+//
+//  Draw and empty the queue of one mesh, as InstanceFlush does
+//
+void InstanceFlushMesh(int id)
+{
+   if (id<0 || id>=Nbatch) Fatal("Invalid instance batch %d\n",id);
+   if (!batch[id].n) return;
+   int prog;
+   glGetIntegerv(GL_CURRENT_PROGRAM,&prog);
+   InstanceBatch(batch+id);
+   glUseProgram(prog);
+}
+
+//
+//  Select instanced (1) or one draw per instance (0)
+//
+void InstanceMode(int on)
+{
+   instanced = on;
+}
+
+//
+//  Return and reset the draw call and instance counts
+//
+void InstanceStats(int* ndraw,int* ninst)
+{
+   *ndraw = draws;
+   *ninst = count;
+   draws = count = 0;
+}
+
+//
+//  Build a column major model matrix
+//    M = P * Translate(x,y,z) * Rotate(th about y) * Scale(s)
+//    P may be NULL for identity
+//
+void InstanceMatrix(float M[16],const float P[16],double x,double y,double z,double th,double s)
+{
+   float L[16] = {s*Cos(th),0,-s*Sin(th),0 , 0,s,0,0 , s*Sin(th),0,s*Cos(th),0 , x,y,z,1};
+   if (!P)
+   {
+      memcpy(M,L,sizeof(L));
+      return;
+   }
+   for (int c=0;c<4;c++)
+      for (int r=0;r<4;r++)
+         M[4*c+r] = P[r]*L[4*c] + P[4+r]*L[4*c+1] + P[8+r]*L[4*c+2] + P[12+r]*L[4*c+3];
+}
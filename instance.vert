@@ -0,0 +1,49 @@
+//  Instanced vertex shader
+//  Per vertex lighting matching the fixed function light 0 setup
+//  Specular and shininess come from the render queue's material of the
+//  draw, as pixel.frag takes them, since the queue does not set
+//  glMaterial for the per pixel lighting path
+#version 120
+#extension GL_ARB_uniform_buffer_object : require
+
+struct material_t
+{
+   vec4 Specular;
+   vec4 Emission;
+   vec4 Shininess;  //  x is the shininess
+};
+
+//  Updated when a material is added
+layout(std140) uniform Materials
+{
+   material_t Mat[256];
+};
+
+uniform int Material;     //  Material of this draw
+
+attribute mat4 Model;     //  Per instance model matrix
+attribute vec4 Color;     //  Per instance color (modulates glColor)
+attribute vec4 Emission;  //  Per instance emission
+
+void main()
+{
+   //  Vertex and normal in eye coordinates
+   vec4 P = gl_ModelViewMatrix * (Model * gl_Vertex);
+   vec3 N = normalize(gl_NormalMatrix * (mat3(Model) * gl_Normal));
+   //  Light and viewer directions (local viewer, positional light)
+   vec3 L = normalize(gl_LightSource[0].position.xyz - P.xyz);
+   vec3 V = normalize(-P.xyz);
+   vec3 H = normalize(L+V);
+   material_t M = Mat[Material];
+   //  glColorMaterial(GL_FRONT_AND_BACK,GL_AMBIENT_AND_DIFFUSE)
+   vec4 C = gl_Color * Color;
+   float Id = max(dot(N,L),0.0);
+   float Is = Id>0.0 ? pow(max(dot(N,H),0.0),M.Shininess.x) : 0.0;
+   vec4 light = Emission
+              + gl_LightModel.ambient*C
+              + gl_LightSource[0].ambient*C
+              + gl_LightSource[0].diffuse*C*Id
+              + gl_LightSource[0].specular*M.Specular*Is;
+   gl_FrontColor = vec4(light.rgb,C.a);
+   gl_Position = gl_ProjectionMatrix * P;
+}
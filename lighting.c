@@ -0,0 +1,111 @@
+//  CSCIx229 library
+//  Per pixel lighting with uniform buffers
+#include "CSCIx229.h"
+
+//
+//  The light lives in one uniform buffer that is written once per frame,
+//  and every render queue material in a second buffer that is written
+//  only when materials are added.  A draw then only sets the index of
+//  its material, instead of the glMaterial and glLight state the fixed
+//  function path revalidates on every change.  The light block is
+//  written to the stream ring and bound by range, so a new light never
+//  waits for frames still using the old one.
+//
+
+#define MAXLIGHTMAT 256  //  Must match the Mat array in pixel.frag
+
+//  std140 layouts of the uniform blocks
+typedef struct
+{
+   float position[4];
+   float ambient[4];
+   float diffuse[4];
+   float specular[4];
+   float global[4];
+} light_t;
+typedef struct
+{
+   float specular[4];
+   float emission[4];
+   float shininess[4];
+} lightmat_t;
+
+static int prog=0;                     //  Lighting shader
+static unsigned int ubo;               //  Material buffer
+static lightmat_t mat[MAXLIGHTMAT];    //  Materials
+static int Nmat=0;                     //  Number of materials
+static int dirty=1;                    //  Materials changed since the upload
+
+//
+//  Set up the lighting shader and its buffers
+//
+void LightingInit(int shader)
+{
+   prog = shader;
+   glGenBuffers(1,&ubo);
+   glBindBuffer(GL_UNIFORM_BUFFER,ubo);
+   glBufferData(GL_UNIFORM_BUFFER,sizeof(mat),NULL,GL_STATIC_DRAW);
+   glBindBuffer(GL_UNIFORM_BUFFER,0);
+   glUniformBlockBinding(prog,glGetUniformBlockIndex(prog,"Light"),0);
+   glUniformBlockBinding(prog,glGetUniformBlockIndex(prog,"Materials"),1);
+   glBindBufferBase(GL_UNIFORM_BUFFER,1,ubo);
+   glUseProgram(prog);
+   glUniform1i(glGetUniformLocation(prog,"Tex"),0);
+   glUseProgram(0);
+}
+
+//
+//  Return the lighting shader (0 before LightingInit)
+//
+int LightingProgram(void)
+{
+   return prog;
+}
+
+//
+//  Set material k
+//
+void LightingMaterial(int k,const float specular[4],float shininess,const float emission[4])
+{
+   if (k<0 || k>=MAXLIGHTMAT) Fatal("Invalid lighting material %d\n",k);
+   memcpy(mat[k].specular,specular,sizeof(mat[k].specular));
+   memcpy(mat[k].emission,emission,sizeof(mat[k].emission));
+   mat[k].shininess[0] = shininess;
+   if (k>=Nmat) Nmat = k+1;
+   dirty = 1;
+}
+
+//
+//  Upload the materials if they changed
+//
+void LightingMaterials(void)
+{
+   if (!prog || !dirty) return;
+   glBindBuffer(GL_UNIFORM_BUFFER,ubo);
+   glBufferSubData(GL_UNIFORM_BUFFER,0,Nmat*sizeof(lightmat_t),mat);
+   glBindBuffer(GL_UNIFORM_BUFFER,0);
+   dirty = 0;
+}
+
+//
+//  Upload the light for this frame
+//    position is in world coordinates and is moved to eye coordinates
+//    by the current modelview matrix, like glLightfv(GL_POSITION)
+//    global is the light model ambient
+//
+void LightingFrame(const float position[4],const float ambient[4],const float diffuse[4],
+                   const float specular[4],const float global[4])
+{
+   if (!prog) return;
+   float V[16];
+   light_t l;
+   glGetFloatv(GL_MODELVIEW_MATRIX,V);
+   for (int i=0;i<4;i++)
+      l.position[i] = V[i]*position[0] + V[4+i]*position[1] + V[8+i]*position[2] + V[12+i]*position[3];
+   memcpy(l.ambient,ambient,sizeof(l.ambient));
+   memcpy(l.diffuse,diffuse,sizeof(l.diffuse));
+   memcpy(l.specular,specular,sizeof(l.specular));
+   memcpy(l.global,global,sizeof(l.global));
+   int off = StreamWrite(&l,sizeof(l));
+   glBindBufferRange(GL_UNIFORM_BUFFER,0,StreamBuffer(),off,sizeof(l));
+}
@@ -254,9 +254,11 @@ static void SetMaterial(const char* name)
 }
 
 //
-//  Load OBJ file
+//  Read vertexes and facets
+//    With a NULL mesh facets are drawn and materials are set (display list)
+//    With a mesh facets are added to the mesh and materials are ignored
 //
-int LoadOBJ(const char* file)
+static void ReadOBJ(FILE* f,mesh_t* mesh)
 {
    int  Nv,Nn,Nt;  //  Number of vertex, normal and textures
    int  Mv,Mn,Mt;  //  Maximum vertex, normal and textures
@@ -266,20 +268,6 @@ int LoadOBJ(const char* file)
    char*  line;    //  Line pointer
    char*  str;     //  String pointer
 
-   //  Open file
-   FILE* f = fopen(file,"r");
-   if (!f) Fatal("Cannot open file %s\n",file);
-
-   // Reset materials
-   mtl = NULL;
-   Nmtl = 0;
-
-   //  Start new displaylist
-   int list = glGenLists(1);
-   glNewList(list,GL_COMPILE);
-   //  Push attributes for textures
-   glPushAttrib(GL_ENABLE_BIT|GL_TEXTURE_BIT);
-
    //  Read vertexes and facets
    V  = N  = T  = NULL;
    Nv = Nn = Nt = 0;
@@ -300,7 +288,7 @@ int LoadOBJ(const char* file)
       {
          line++;
          //  Read Vertex/Texture/Normal triplets
-         glBegin(GL_POLYGON);
+         MeshBegin(mesh,GL_POLYGON);
          while ((str = getword(&line)))
          {
             int Kv,Kt,Kn;
@@ -329,20 +317,49 @@ int LoadOBJ(const char* file)
             else
                Fatal("Invalid facet %s\n",str);
             //  Draw vectors
-            if (Kt) glTexCoord2fv(T+2*(Kt-1));
-            if (Kn) glNormal3fv(N+3*(Kn-1));
-            if (Kv) glVertex3fv(V+3*(Kv-1));
+            if (Kt) MeshTexCoord(mesh,T[2*Kt-2],T[2*Kt-1]);
+            if (Kn) MeshNormal(mesh,N[3*Kn-3],N[3*Kn-2],N[3*Kn-1]);
+            if (Kv) MeshVertex(mesh,V[3*Kv-3],V[3*Kv-2],V[3*Kv-1]);
          }
-         glEnd();
+         MeshEnd(mesh);
       }
       //  Use material
-      else if ((str = readstr(line,"usemtl")))
+      else if (!mesh && (str = readstr(line,"usemtl")))
          SetMaterial(str);
       //  Load materials
-      else if ((str = readstr(line,"mtllib")))
+      else if (!mesh && (str = readstr(line,"mtllib")))
          LoadMaterial(str);
       //  Skip this line
    }
+
+   //  Free arrays
+   free(V);
+   free(T);
+   free(N);
+}
+
+//
+//  Load OBJ file
+//
+int LoadOBJ(const char* file)
+{
+   TraceBegin("LoadOBJ",file);
+   //  Open file
+   FILE* f = fopen(file,"r");
+   if (!f) Fatal("Cannot open file %s\n",file);
+
+   // Reset materials
+   mtl = NULL;
+   Nmtl = 0;
+
+   //  Start new displaylist
+   int list = glGenLists(1);
+   glNewList(list,GL_COMPILE);
+   //  Push attributes for textures
+   glPushAttrib(GL_ENABLE_BIT|GL_TEXTURE_BIT);
+
+   //  Draw vertexes and facets
+   ReadOBJ(f,NULL);
    fclose(f);
    //  Pop attributes (textures)
    glPopAttrib();
@@ -353,10 +370,37 @@ int LoadOBJ(const char* file)
       free(mtl[k].name);
    free(mtl);
 
-   //  Free arrays
-   free(V);
-   free(T);
-   free(N);
-
+   TraceEnd();
    return list;
 }
+
+//
+//  Read OBJ file into a mesh without uploading it
+//  Returns the number of triangles
+//
+int ReadOBJMesh(const char* file,mesh_t* mesh)
+{
+   //  Open file
+   FILE* f = fopen(file,"r");
+   if (!f) Fatal("Cannot open file %s\n",file);
+   //  Read vertexes and facets into the mesh
+   MeshInit(mesh);
+   ReadOBJ(f,mesh);
+   fclose(f);
+   return mesh->ni/3;
+}
+
+//
+//  Load OBJ file into a mesh and upload it
+//  Materials and textures are not supported, so color the mesh with
+//  glColor or the instance color instead
+//  Returns the number of triangles
+//
+int LoadOBJMesh(const char* file,mesh_t* mesh)
+{
+   TraceBegin("LoadOBJMesh",file);
+   ReadOBJMesh(file,mesh);
+   MeshUpload(mesh);
+   TraceEnd();
+   return mesh->ni/3;
+}
@@ -20,11 +20,25 @@ static void Reverse(void* x,const int n)
    }
 }
 
+//
+//  Swap the red and blue bytes of size bytes of packed 24 bit pixels
+//
+void BGRtoRGB(unsigned char* image,unsigned int size)
+{
+   for (unsigned int k=0;k+2<size;k+=3)
+   {
+      unsigned char temp = image[k];
+      image[k]   = image[k+2];
+      image[k+2] = temp;
+   }
+}
+
 //
 //  Load texture from BMP file
 //
 unsigned int LoadTexBMP(const char* file)
 {
+   TraceBegin("LoadTexBMP",file);
    //  Open file
    FILE* f = fopen(file,"rb");
    if (!f) Fatal("Cannot open file %s\n",file);
@@ -73,12 +87,7 @@ unsigned int LoadTexBMP(const char* file)
    if (fseek(f,off,SEEK_SET) || fread(image,size,1,f)!=1) Fatal("Error reading data from image %s\n",file);
    fclose(f);
    //  Reverse colors (BGR -> RGB)
-   for (k=0;k<size;k+=3)
-   {
-      unsigned char temp = image[k];
-      image[k]   = image[k+2];
-      image[k+2] = temp;
-   }
+   BGRtoRGB(image,size);
 
    //  Sanity check
    ErrCheck("LoadTexBMP");
@@ -86,6 +95,7 @@ unsigned int LoadTexBMP(const char* file)
    unsigned int texture;
    glGenTextures(1,&texture);
    glBindTexture(GL_TEXTURE_2D,texture);
+   DebugLabel(GL_TEXTURE,texture,file);
    //  Copy image
    glTexImage2D(GL_TEXTURE_2D,0,GL_RGB,dx,dy,0,GL_RGB,GL_UNSIGNED_BYTE,image);
    if (glGetError()) Fatal("Error in glTexImage2D %s %dx%d\n",file,dx,dy);
@@ -95,6 +105,7 @@ unsigned int LoadTexBMP(const char* file)
 
    //  Free image memory
    free(image);
+   TraceEnd();
    //  Return texture name
    return texture;
 }
@@ -0,0 +1,298 @@
+//  CSCIx229 library
+//  Mesh builder
+#include "CSCIx229.h"
+
+//
+//  The Mesh* calls mirror glBegin/glNormal/glColor/glVertex/glEnd.
+//  With a mesh they assemble indexed triangles that can be uploaded to
+//  buffer objects; with a NULL mesh they are forwarded to immediate mode,
+//  so a shape only has to be written once to be drawn either way.
+//
+
+static int draws=0;  //  MeshDraw calls since the last MeshStats
+
+//
+//  Initialize an empty mesh
+//
+void MeshInit(mesh_t* m)
+{
+   memset(m,0,sizeof(mesh_t));
+   m->cur.nz = 1;
+   m->cur.r = m->cur.g = m->cur.b = m->cur.a = 1;
+}
+
+//
+//  Make room for n more vertexes and k more indexes
+//
+static void MeshGrow(mesh_t* m,int n,int k)
+{
+   if (m->nv+n > m->mv)
+   {
+      while (m->nv+n > m->mv) m->mv = m->mv ? 2*m->mv : 1024;
+      m->v = (vtx_t*)realloc(m->v,m->mv*sizeof(vtx_t));
+      if (!m->v) Fatal("Cannot allocate %d vertexes for mesh\n",m->mv);
+   }
+   if (m->ni+k > m->mi)
+   {
+      while (m->ni+k > m->mi) m->mi = m->mi ? 2*m->mi : 3072;
+      m->idx = (unsigned int*)realloc(m->idx,m->mi*sizeof(unsigned int));
+      if (!m->idx) Fatal("Cannot allocate %d indexes for mesh\n",m->mi);
+   }
+}
+
+//
+//  Add a triangle by vertex number
+//
+static void MeshTriangle(mesh_t* m,unsigned int a,unsigned int b,unsigned int c)
+{
+   MeshGrow(m,0,3);
+   m->idx[m->ni++] = a;
+   m->idx[m->ni++] = b;
+   m->idx[m->ni++] = c;
+}
+
+//
+//  Start a primitive (GL_TRIANGLES, GL_QUADS, GL_QUAD_STRIP,
+//  GL_TRIANGLE_STRIP, GL_TRIANGLE_FAN or GL_POLYGON)
+//
+void MeshBegin(mesh_t* m,int mode)
+{
+   if (!m)
+   {
+      glBegin(mode);
+      return;
+   }
+   m->mode  = mode;
+   m->first = m->nv;
+}
+
+//
+//  Finish a primitive by splitting it into triangles
+//
+void MeshEnd(mesh_t* m)
+{
+   if (!m)
+   {
+      glEnd();
+      return;
+   }
+   unsigned int f = m->first;
+   int n = m->nv - m->first;
+   switch (m->mode)
+   {
+      case GL_TRIANGLES:
+         for (int k=0;k+2<n;k+=3)
+            MeshTriangle(m,f+k,f+k+1,f+k+2);
+         break;
+      case GL_QUADS:
+         for (int k=0;k+3<n;k+=4)
+         {
+            MeshTriangle(m,f+k,f+k+1,f+k+2);
+            MeshTriangle(m,f+k,f+k+2,f+k+3);
+         }
+         break;
+      case GL_QUAD_STRIP:
+         for (int k=0;k+3<n;k+=2)
+         {
+            MeshTriangle(m,f+k,f+k+1,f+k+3);
+            MeshTriangle(m,f+k,f+k+3,f+k+2);
+         }
+         break;
+      case GL_TRIANGLE_STRIP:
+         for (int k=0;k+2<n;k++)
+            if (k%2)
+               MeshTriangle(m,f+k+1,f+k,f+k+2);
+            else
+               MeshTriangle(m,f+k,f+k+1,f+k+2);
+         break;
+      case GL_TRIANGLE_FAN:
+      case GL_POLYGON:
+         for (int k=1;k+1<n;k++)
+            MeshTriangle(m,f,f+k,f+k+1);
+         break;
+      default:
+         Fatal("Unsupported mesh primitive %d\n",m->mode);
+   }
+}
+
+//
+//  Set current normal
+//
+void MeshNormal(mesh_t* m,double nx,double ny,double nz)
+{
+   if (!m)
+   {
+      glNormal3d(nx,ny,nz);
+      return;
+   }
+   m->cur.nx = nx;
+   m->cur.ny = ny;
+   m->cur.nz = nz;
+}
+
+//
+//  Set current texture coordinate
+//
+void MeshTexCoord(mesh_t* m,double s,double t)
+{
+   if (!m)
+   {
+      glTexCoord2d(s,t);
+      return;
+   }
+   m->cur.s = s;
+   m->cur.t = t;
+}
+
+//
+//  Set current color
+//
+void MeshColor(mesh_t* m,double r,double g,double b,double a)
+{
+   if (!m)
+   {
+      glColor4d(r,g,b,a);
+      return;
+   }
+   m->cur.r = r;
+   m->cur.g = g;
+   m->cur.b = b;
+   m->cur.a = a;
+   m->color = 1;
+}
+
+//
+//  Add a vertex with the current normal, texture and color
+//
+void MeshVertex(mesh_t* m,double x,double y,double z)
+{
+   if (!m)
+   {
+      glVertex3d(x,y,z);
+      return;
+   }
+   MeshGrow(m,1,0);
+   vtx_t* v = m->v + m->nv++;
+   *v = m->cur;
+   v->x = x;
+   v->y = y;
+   v->z = z;
+}
+
+//
+//  Append src to dst transformed by the column major matrix M
+//    M may be NULL for identity; normals use its upper 3x3, so M
+//    should only scale uniformly (GL_NORMALIZE fixes the length)
+//    color is used for a src without vertex colors (NULL for white)
+//
+void MeshAppend(mesh_t* dst,const mesh_t* src,const float M[16],const float color[4])
+{
+   static const float I[16] = {1,0,0,0 , 0,1,0,0 , 0,0,1,0 , 0,0,0,1};
+   static const float white[4] = {1,1,1,1};
+   if (!M) M = I;
+   if (!color) color = white;
+   MeshGrow(dst,src->nv,src->ni);
+   unsigned int base = dst->nv;
+   for (int k=0;k<src->nv;k++)
+   {
+      const vtx_t* s = src->v+k;
+      vtx_t* d = dst->v + dst->nv++;
+      *d = *s;
+      d->x  = M[0]*s->x + M[4]*s->y + M[8]*s->z  + M[12];
+      d->y  = M[1]*s->x + M[5]*s->y + M[9]*s->z  + M[13];
+      d->z  = M[2]*s->x + M[6]*s->y + M[10]*s->z + M[14];
+      d->nx = M[0]*s->nx + M[4]*s->ny + M[8]*s->nz;
+      d->ny = M[1]*s->nx + M[5]*s->ny + M[9]*s->nz;
+      d->nz = M[2]*s->nx + M[6]*s->ny + M[10]*s->nz;
+      if (!src->color)
+      {
+         d->r = color[0];
+         d->g = color[1];
+         d->b = color[2];
+         d->a = color[3];
+      }
+   }
+   for (int k=0;k<src->ni;k++)
+      dst->idx[dst->ni++] = base + src->idx[k];
+   dst->color = 1;
+}
+
+//
+//  Copy vertexes and indexes to buffer objects
+//  The CPU copy is kept so the mesh can still be merged or re-uploaded
+//
+void MeshUpload(mesh_t* m)
+{
+   if (!m->vbo) glGenBuffers(1,&m->vbo);
+   if (!m->ibo) glGenBuffers(1,&m->ibo);
+   glBindBuffer(GL_ARRAY_BUFFER,m->vbo);
+   glBufferData(GL_ARRAY_BUFFER,m->nv*sizeof(vtx_t),m->v,GL_STATIC_DRAW);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m->ibo);
+   glBufferData(GL_ELEMENT_ARRAY_BUFFER,m->ni*sizeof(unsigned int),m->idx,GL_STATIC_DRAW);
+   glBindBuffer(GL_ARRAY_BUFFER,0);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+   m->count = m->ni;
+}
+
+//
+//  Bind the mesh buffers as the fixed function vertex arrays
+//  Meshes without per vertex colors use the current color
+//
+void MeshBind(const mesh_t* m)
+{
+   glBindBuffer(GL_ARRAY_BUFFER,m->vbo);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m->ibo);
+   glEnableClientState(GL_VERTEX_ARRAY);
+   glEnableClientState(GL_NORMAL_ARRAY);
+   glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+   if (m->color) glEnableClientState(GL_COLOR_ARRAY);
+   glVertexPointer(3,GL_FLOAT,sizeof(vtx_t),(void*)offsetof(vtx_t,x));
+   glNormalPointer(GL_FLOAT,sizeof(vtx_t),(void*)offsetof(vtx_t,nx));
+   glTexCoordPointer(2,GL_FLOAT,sizeof(vtx_t),(void*)offsetof(vtx_t,s));
+   glColorPointer(4,GL_FLOAT,sizeof(vtx_t),(void*)offsetof(vtx_t,r));
+}
+
+//
+//  Undo MeshBind
+//
+void MeshUnbind(void)
+{
+   glDisableClientState(GL_VERTEX_ARRAY);
+   glDisableClientState(GL_NORMAL_ARRAY);
+   glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+   glDisableClientState(GL_COLOR_ARRAY);
+   glBindBuffer(GL_ARRAY_BUFFER,0);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+}
+
+//
+//  Draw an uploaded mesh with the current transformation
+//
+void MeshDraw(const mesh_t* m)
+{
+   MeshBind(m);
+   glDrawElements(GL_TRIANGLES,m->count,GL_UNSIGNED_INT,(void*)0);
+   MeshUnbind();
+   draws++;
+}
+
+//
+//  Return and reset the number of MeshDraw calls
+//
+void MeshStats(int* ndraw)
+{
+   *ndraw = draws;
+   draws = 0;
+}
+
+//
+//  Release buffers and memory
+//
+void MeshFree(mesh_t* m)
+{
+   if (m->vbo) glDeleteBuffers(1,&m->vbo);
+   if (m->ibo) glDeleteBuffers(1,&m->ibo);
+   free(m->v);
+   free(m->idx);
+   MeshInit(m);
+}
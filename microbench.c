@@ -0,0 +1,281 @@
+/*
+ *  Microbenchmarks of the library's hot kernels and the procedural
+ *  geometry generators, compared against a baseline
+ *
+ *  make bench
+ *  ./microbench [--baseline FILE] [--write FILE] [--threshold PCT]
+ *
+ *  Each kernel is run on a growing batch until one batch takes MINREP
+ *  seconds, warmed up with WARMUP more batches, then timed over REPS
+ *  batches.  The median time per operation is compared against the
+ *  baseline, and a kernel slower than it by more than the threshold is
+ *  a regression, which makes the exit status 1.  --write saves this run
+ *  as the new baseline.
+ */
+
+#include "CSCIx229.h"
+#include <unistd.h>
+
+#define WARMUP 3      //  Batches run before timing
+#define REPS   15     //  Batches timed
+#define MINREP 0.01   //  Shortest batch in seconds
+#define PIXELS (1<<20)  //  Pixels of the swizzled image
+#define OBJGRID 60      //  Quads on a side of the generated OBJ
+
+typedef double (*kernel_t)(long n);  //  Runs n operations and returns a checksum
+
+typedef struct {
+   const char* name;  //  Kernel name in the report and baseline
+   kernel_t run;      //  Kernel
+   double min, median, mean, sd;  //  Nanoseconds per operation
+} result_t;
+
+static volatile double sink;  //  Keeps the checksums alive
+static mesh_t mesh;           //  Mesh the generators write into
+static unsigned char* image;  //  Image for the swizzle
+static char objFile[64];      //  Generated OBJ file
+
+/*
+ *  The kernels
+ */
+static double RawNoise(long n){
+   double sum = 0;
+   for (long k = 0; k < n; k++)
+      sum += rawnoise(k);
+   return sum;
+}
+static double Smooth3d(long n){
+   double sum = 0;
+   for (long k = 0; k < n; k++)
+      sum += smooth3d(0.37*k, 0.11*k, 0.05*k, 0, 12124);
+   return sum;
+}
+static double PNoise3d(long n){
+   double sum = 0;
+   for (long k = 0; k < n; k++)
+      sum += pnoise3d(0.2*(k%100), 0.2*(k/100%100), 0.01*k, 0.1, 5, 12124);
+   return sum;
+}
+static double HsvToRgb(long n){
+   double sum = 0;
+   for (long k = 0; k < n; k++){
+      double hsv[] = {fmod(k*137.508, 360), 0.7, 1};
+      GLfloat rgb[3];
+      hsvToRgb(hsv, rgb);
+      sum += rgb[0]+rgb[1]+rgb[2];
+   }
+   return sum;
+}
+static double CalcNormal(long n){
+   for (long k = 0; k < n; k++)
+      calcNormalMesh(&mesh, 0, 0, k, 1, 0.5*k, 0, 0, 1, 2);
+   return mesh.cur.nx+mesh.cur.ny+mesh.cur.nz;
+}
+static double Swizzle(long n){
+   //  An operation is one pixel
+   for (long k = 0; k < n; k += PIXELS)
+      BGRtoRGB(image, 3*(n-k < PIXELS ? n-k : PIXELS));
+   return image[n%PIXELS];
+}
+static double ObjRead(long n){
+   //  An operation is a parse of the whole file, without the upload
+   double sum = 0;
+   for (long k = 0; k < n; k++){
+      mesh_t m;
+      sum += ReadOBJMesh(objFile, &m);
+      MeshFree(&m);
+   }
+   return sum;
+}
+
+/*
+ *  Run generator build with parameters p n times into the shared mesh
+ */
+static double Generate(long n, geobuild_t build, const double p[]){
+   double sum = 0;
+   for (long k = 0; k < n; k++){
+      mesh.nv = mesh.ni = 0;
+      build(&mesh, p);
+      sum += mesh.ni;
+   }
+   return sum;
+}
+static double SphereGen(long n){
+   double p[] = {10};
+   return Generate(n, Sphere, p);
+}
+static double TubeGen(long n){
+   double p[] = {2, 0.2, 360, 1};
+   return Generate(n, TubeGeometry, p);
+}
+static double CarGen(long n){
+   double p[] = {1, 2, 1};
+   return Generate(n, CarGeometry, p);
+}
+static double HexGen(long n){
+   double sum = 0;
+   for (long k = 0; k < n; k++){
+      mesh.nv = mesh.ni = 0;
+      sum += HexColumn(&mesh, 0, 0, 0, 1, 1, 1, 0);
+   }
+   return sum;
+}
+
+static result_t kernel[] = {
+   {"rawnoise", RawNoise},
+   {"smooth3d", Smooth3d},
+   {"pnoise3d", PNoise3d},
+   {"hsvToRgb", HsvToRgb},
+   {"calcNormal", CalcNormal},
+   {"BGRtoRGB pixel", Swizzle},
+   {"ReadOBJMesh file", ObjRead},
+   {"Sphere", SphereGen},
+   {"TubeGeometry", TubeGen},
+   {"CarGeometry", CarGen},
+   {"HexColumn", HexGen},
+};
+#define NKERNEL (int)(sizeof(kernel)/sizeof(kernel[0]))
+
+/*
+ *  Order doubles for qsort
+ */
+static int Compare(const void* a, const void* b){
+   double d = *(const double*)a - *(const double*)b;
+   return d < 0 ? -1 : d > 0;
+}
+
+/*
+ *  Time one batch of n operations in seconds
+ */
+static double Batch(result_t* r, long n){
+   double t = Timer();
+   sink += r->run(n);
+   return Timer()-t;
+}
+
+/*
+ *  Calibrate, warm up and time a kernel
+ */
+static void Measure(result_t* r){
+   long n = 1;
+   while (Batch(r, n) < MINREP) n *= 2;
+   for (int k = 0; k < WARMUP; k++)
+      Batch(r, n);
+   double ns[REPS], sum = 0, sq = 0;
+   for (int k = 0; k < REPS; k++){
+      ns[k] = 1e9*Batch(r, n)/n;
+      sum += ns[k];
+   }
+   qsort(ns, REPS, sizeof(double), Compare);
+   r->min = ns[0];
+   r->median = ns[REPS/2];
+   r->mean = sum/REPS;
+   for (int k = 0; k < REPS; k++)
+      sq += (ns[k]-r->mean)*(ns[k]-r->mean);
+   r->sd = sqrt(sq/(REPS-1));
+}
+
+/*
+ *  Median of kernel name in the baseline text (0 if it is not there)
+ */
+static double Baseline(const char* text, const char* name){
+   char key[128];
+   snprintf(key, sizeof(key), "\"%s\"", name);
+   const char* s = text ? strstr(text, key) : NULL;
+   double median = 0;
+   if (s && (s = strstr(s, "\"median_ns\":"))) sscanf(s+12, "%lf", &median);
+   return median;
+}
+
+/*
+ *  Read a whole file (NULL if it cannot be read)
+ */
+static char* ReadFile(const char* file){
+   FILE* f = fopen(file, "r");
+   if (!f) return NULL;
+   fseek(f, 0, SEEK_END);
+   long n = ftell(f);
+   rewind(f);
+   char* text = (char*)malloc(n+1);
+   if (!text) Fatal("Cannot allocate %ld bytes for %s\n", n+1, file);
+   text[fread(text, 1, n, f)] = 0;
+   fclose(f);
+   return text;
+}
+
+/*
+ *  Write a quad grid with positions, texture coordinates and normals
+ */
+static void WriteOBJ(const char* file){
+   FILE* f = fopen(file, "w");
+   if (!f) Fatal("Cannot write %s\n", file);
+   for (int i = 0; i <= OBJGRID; i++)
+      for (int j = 0; j <= OBJGRID; j++){
+         fprintf(f, "v %f %f %f\n", (double)i, 0.1*sin(i+j), (double)j);
+         fprintf(f, "vt %f %f\n", (double)i/OBJGRID, (double)j/OBJGRID);
+         fprintf(f, "vn 0 1 0\n");
+      }
+   for (int i = 0; i < OBJGRID; i++)
+      for (int j = 0; j < OBJGRID; j++){
+         int a = i*(OBJGRID+1)+j+1, b = a+OBJGRID+1;
+         fprintf(f, "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, a+1, a+1, a+1, b+1, b+1, b+1, b, b, b);
+      }
+   fclose(f);
+}
+
+int main(int argc, char* argv[]){
+   const char* baseline = NULL;
+   const char* write = NULL;
+   double threshold = 15;
+   for (int k = 1; k < argc; k++){
+      if (!strcmp(argv[k], "--baseline") && k+1 < argc)
+         baseline = argv[++k];
+      else if (!strcmp(argv[k], "--write") && k+1 < argc)
+         write = argv[++k];
+      else if (!strcmp(argv[k], "--threshold") && k+1 < argc)
+         threshold = atof(argv[++k]);
+      else
+         Fatal("Usage: %s [--baseline file] [--write file] [--threshold percent]\n", argv[0]);
+   }
+   MeshInit(&mesh);
+   image = (unsigned char*)malloc(3*PIXELS);
+   if (!image) Fatal("Cannot allocate benchmark image\n");
+   for (int k = 0; k < 3*PIXELS; k++)
+      image[k] = k*7;
+   snprintf(objFile, sizeof(objFile), "/tmp/microbench%d.obj", (int)getpid());
+   WriteOBJ(objFile);
+
+   char* text = baseline ? ReadFile(baseline) : NULL;
+   if (baseline && !text) fprintf(stderr, "No baseline %s, nothing to compare\n", baseline);
+   int regressions = 0;
+   printf("%-18s %12s %12s %12s %6s %10s\n", "kernel", "median ns", "min ns", "mean ns", "sd %", "baseline");
+   for (int k = 0; k < NKERNEL; k++){
+      result_t* r = kernel+k;
+      Measure(r);
+      double base = Baseline(text, r->name);
+      printf("%-18s %12.1f %12.1f %12.1f %6.1f", r->name, r->median, r->min, r->mean, 100*r->sd/r->mean);
+      if (base > 0){
+         double change = 100*(r->median/base-1);
+         int slow = change > threshold;
+         printf(" %+9.1f%%%s", change, slow ? "  REGRESSION" : "");
+         regressions += slow;
+      }
+      printf("\n");
+   }
+   remove(objFile);
+
+   if (write){
+      FILE* f = fopen(write, "w");
+      if (!f) Fatal("Cannot write %s\n", write);
+      fprintf(f, "{\n  \"kernels\": {");
+      for (int k = 0; k < NKERNEL; k++)
+         fprintf(f, "%s\n    \"%s\": {\"median_ns\": %.3f, \"min_ns\": %.3f, \"mean_ns\": %.3f, \"sd_ns\": %.3f}",
+                 k ? "," : "", kernel[k].name, kernel[k].median, kernel[k].min, kernel[k].mean, kernel[k].sd);
+      fprintf(f, "\n  }\n}\n");
+      fclose(f);
+      printf("Wrote baseline %s\n", write);
+   }
+   if (regressions) printf("%d kernels more than %.0f%% slower than the baseline\n", regressions, threshold);
+   free(text);
+   return regressions ? 1 : 0;
+}
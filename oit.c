@@ -0,0 +1,138 @@
+//  CSCIx229 library
+//  Weighted blended order independent transparency
+#include "CSCIx229.h"
+
+//
+//  Transparent surfaces are drawn in any order into two float targets
+//  that share a copy of the opaque depth buffer: the weighted sum of
+//  premultiplied colors with the product of (1-alpha) in its alpha, and
+//  the sum of the weights.  OITEnd then blends their weighted average
+//  over the scene in one full screen pass (McGuire and Bavoil 2013).
+//  Both targets use one blend function so only GL 3.0 is needed.
+//
+
+static int composite=0;             //  Composite shader
+static unsigned int fbo=0;          //  Framebuffer
+static unsigned int tex[2];         //  Accumulation and weight targets
+static unsigned int depth=0;        //  Depth copied from the scene
+static int width=0,height=0;        //  Target size
+
+//
+//  Set the composite shader program
+//    the accumulation shader is bound by the caller
+//
+void OITInit(int prog)
+{
+   composite = prog;
+}
+
+//
+//  Make targets the size of the viewport
+//    the depth format has to match the window's for the depth copy
+//
+static void OITResize(int w,int h)
+{
+   if (w==width && h==height) return;
+   width  = w;
+   height = h;
+   if (!fbo)
+   {
+      glGenFramebuffers(1,&fbo);
+      glGenTextures(2,tex);
+      glGenRenderbuffers(1,&depth);
+   }
+   for (int k=0;k<2;k++)
+   {
+      glBindTexture(GL_TEXTURE_2D,tex[k]);
+      glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA16F,w,h,0,GL_RGBA,GL_FLOAT,NULL);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+   }
+   glBindTexture(GL_TEXTURE_2D,0);
+   int bits,stencil;
+   glGetIntegerv(GL_DEPTH_BITS,&bits);
+   glGetIntegerv(GL_STENCIL_BITS,&stencil);
+   int format = stencil ? GL_DEPTH24_STENCIL8 : bits>24 ? GL_DEPTH_COMPONENT32 : bits>16 ? GL_DEPTH_COMPONENT24 : GL_DEPTH_COMPONENT16;
+   glBindRenderbuffer(GL_RENDERBUFFER,depth);
+   glRenderbufferStorage(GL_RENDERBUFFER,format,w,h);
+   glBindRenderbuffer(GL_RENDERBUFFER,0);
+   glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+   glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,tex[0],0);
+   glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT1,GL_TEXTURE_2D,tex[1],0);
+   glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,GL_RENDERBUFFER,depth);
+   if (stencil) glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_STENCIL_ATTACHMENT,GL_RENDERBUFFER,depth);
+   if (glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE) Fatal("Transparency framebuffer incomplete\n");
+   glBindFramebuffer(GL_FRAMEBUFFER,0);
+}
+
+//
+//  Start drawing transparent surfaces
+//    call after the opaque scene is drawn to the window
+//
+void OITBegin(void)
+{
+   int vp[4];
+   glGetIntegerv(GL_VIEWPORT,vp);
+   OITResize(vp[2],vp[3]);
+   glPushAttrib(GL_VIEWPORT_BIT|GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT|GL_ENABLE_BIT);
+   //  Copy the opaque depth so transparent surfaces behind it are hidden
+   glBindFramebuffer(GL_READ_FRAMEBUFFER,0);
+   glBindFramebuffer(GL_DRAW_FRAMEBUFFER,fbo);
+   glBlitFramebuffer(vp[0],vp[1],vp[0]+vp[2],vp[1]+vp[3],0,0,vp[2],vp[3],GL_DEPTH_BUFFER_BIT,GL_NEAREST);
+   glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+   //  Accumulation starts at 0 with a revealage of 1
+   const GLenum buf[2] = {GL_COLOR_ATTACHMENT0,GL_COLOR_ATTACHMENT1};
+   glViewport(0,0,vp[2],vp[3]);
+   glDrawBuffers(2,buf);
+   glClearColor(0,0,0,1);
+   glClear(GL_COLOR_BUFFER_BIT);
+   glEnable(GL_BLEND);
+   glBlendFuncSeparate(GL_ONE,GL_ONE,GL_ZERO,GL_ONE_MINUS_SRC_ALPHA);
+   glDepthMask(0);
+   glDisable(GL_CULL_FACE);
+}
+
+//
+//  Blend the transparent surfaces over the window
+//
+void OITEnd(void)
+{
+   glBindFramebuffer(GL_FRAMEBUFFER,0);
+   glPopAttrib();
+
+   glPushAttrib(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT|GL_ENABLE_BIT|GL_TEXTURE_BIT);
+   glDisable(GL_DEPTH_TEST);
+   glDisable(GL_LIGHTING);
+   glEnable(GL_BLEND);
+   glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+   glUseProgram(composite);
+   glUniform1i(glGetUniformLocation(composite,"Accum"),0);
+   glUniform1i(glGetUniformLocation(composite,"Weight"),1);
+   glUniform2f(glGetUniformLocation(composite,"Size"),width,height);
+   glActiveTexture(GL_TEXTURE1);
+   glBindTexture(GL_TEXTURE_2D,tex[1]);
+   glActiveTexture(GL_TEXTURE0);
+   glBindTexture(GL_TEXTURE_2D,tex[0]);
+   //  Full screen quad
+   glMatrixMode(GL_PROJECTION);
+   glPushMatrix();
+   glLoadIdentity();
+   glMatrixMode(GL_MODELVIEW);
+   glPushMatrix();
+   glLoadIdentity();
+   glBegin(GL_QUADS);
+   glVertex2f(-1,-1);
+   glVertex2f(+1,-1);
+   glVertex2f(+1,+1);
+   glVertex2f(-1,+1);
+   glEnd();
+   glPopMatrix();
+   glMatrixMode(GL_PROJECTION);
+   glPopMatrix();
+   glMatrixMode(GL_MODELVIEW);
+   glUseProgram(0);
+   glActiveTexture(GL_TEXTURE1);
+   glBindTexture(GL_TEXTURE_2D,0);
+   glActiveTexture(GL_TEXTURE0);
+   glPopAttrib();
+}
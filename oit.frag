@@ -0,0 +1,15 @@
+//  Weighted blended transparency accumulation
+//  Blended with ONE,ONE for color and ZERO,ONE_MINUS_SRC_ALPHA for alpha
+#version 120
+
+void main()
+{
+   vec4 C = clamp(gl_Color,0.0,1.0);
+   //  Weight favors near and opaque fragments (McGuire and Bavoil 2013)
+   float z = 1.0-0.9*gl_FragCoord.z;
+   float w = clamp(pow(min(1.0,C.a*10.0)+0.01,3.0)*1e8*z*z*z,1e-2,3e3);
+   //  Weighted premultiplied color, alpha multiplies into the revealage
+   gl_FragData[0] = vec4(C.rgb*C.a*w,C.a);
+   //  Sum of weights
+   gl_FragData[1] = vec4(C.a*w);
+}
@@ -0,0 +1,25 @@
+//  Weighted blended transparency vertex shader
+//  Per vertex lighting matching the fixed function light 0 setup
+#version 120
+
+void main()
+{
+   //  Vertex and normal in eye coordinates
+   vec4 P = gl_ModelViewMatrix * gl_Vertex;
+   vec3 N = normalize(gl_NormalMatrix * gl_Normal);
+   //  Light and viewer directions (local viewer, positional light)
+   vec3 L = normalize(gl_LightSource[0].position.xyz - P.xyz);
+   vec3 V = normalize(-P.xyz);
+   vec3 H = normalize(L+V);
+   //  glColorMaterial(GL_FRONT_AND_BACK,GL_AMBIENT_AND_DIFFUSE)
+   vec4 C = gl_Color;
+   float Id = max(dot(N,L),0.0);
+   float Is = Id>0.0 ? pow(max(dot(N,H),0.0),gl_FrontMaterial.shininess) : 0.0;
+   vec4 light = gl_FrontMaterial.emission
+              + gl_LightModel.ambient*C
+              + gl_LightSource[0].ambient*C
+              + gl_LightSource[0].diffuse*C*Id
+              + gl_LightSource[0].specular*gl_FrontMaterial.specular*Is;
+   gl_FrontColor = vec4(light.rgb,C.a);
+   gl_Position = gl_ProjectionMatrix * P;
+}
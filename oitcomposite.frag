@@ -0,0 +1,17 @@
+//  Weighted blended transparency composite
+//  Blended over the opaque scene with SRC_ALPHA,ONE_MINUS_SRC_ALPHA
+#version 120
+
+uniform sampler2D Accum;   //  Weighted color and revealage
+uniform sampler2D Weight;  //  Sum of weights
+uniform vec2 Size;         //  Viewport size
+
+void main()
+{
+   vec2 st = gl_FragCoord.xy/Size;
+   vec4 A = texture2D(Accum,st);
+   float reveal = A.a;
+   if (reveal>=1.0) discard;
+   float w = texture2D(Weight,st).r;
+   gl_FragColor = vec4(A.rgb/max(w,1e-5),1.0-reveal);
+}
@@ -0,0 +1,90 @@
+//  CSCIx229 library
+//  Frame pacing and CPU use
+#include "CSCIx229.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+//
+//  PaceWait holds the caller until the next frame of a fixed rate is
+//  due.  It sleeps until SPIN before the deadline, since the scheduler
+//  may wake a sleeper late by a millisecond or more, and spins on the
+//  clock for the rest.  Deadlines advance by whole periods so the rate
+//  does not drift, but a caller that falls more than a period behind
+//  starts over from now rather than rushing frames to catch up.
+//
+//  PaceCPU returns the process CPU time over wall time, which counts
+//  every thread, including any the driver runs, so it can pass 100%.
+//
+
+#define SPIN   0.001  //  Seconds spun before each deadline
+#define WINDOW 1.0    //  Seconds CPU use is averaged over
+
+static double period=0;   //  Seconds per frame (0 for unpaced)
+static double next=0;     //  Deadline of the next frame
+static double wall0=-1;   //  Start of the CPU window
+static clock_t cpu0;
+static double cpu=0;      //  CPU use of the last window in percent
+
+//
+//  Pace frames at hz a second (0 to not pace)
+//
+void PaceRate(double hz)
+{
+   period = hz>0 ? 1/hz : 0;
+   next = 0;
+}
+
+//
+//  Sleep for s seconds
+//
+static void PaceSleep(double s)
+{
+#ifdef _WIN32
+   Sleep((DWORD)(1000*s));
+#else
+   struct timespec ts;
+   ts.tv_sec = (time_t)s;
+   ts.tv_nsec = (long)(1e9*(s-ts.tv_sec));
+   nanosleep(&ts,NULL);
+#endif
+}
+
+//
+//  Wait for the next frame
+//
+void PaceWait(void)
+{
+   if (period<=0) return;
+   double now = Timer();
+   //  First frame or too far behind to catch up
+   if (now-next > period)
+   {
+      next = now+period;
+      return;
+   }
+   if (next-now > SPIN) PaceSleep(next-now-SPIN);
+   while (Timer()<next);
+   next += period;
+}
+
+//
+//  Percent of one core the process used over the last second or so
+//
+double PaceCPU(void)
+{
+   double now = Timer();
+   clock_t c = clock();
+   if (wall0<0)
+   {
+      wall0 = now;
+      cpu0 = c;
+   }
+   else if (now-wall0 >= WINDOW)
+   {
+      cpu = 100.0*(c-cpu0)/CLOCKS_PER_SEC/(now-wall0);
+      wall0 = now;
+      cpu0 = c;
+   }
+   return cpu;
+}
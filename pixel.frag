@@ -0,0 +1,112 @@
+//  Per pixel lighting fragment shader
+//  Light and materials come from uniform buffers, so one light and
+//  material setup is shared by every draw and a draw only selects
+//  its material.  Matches the fixed function light 0 setup with
+//  glColorMaterial(GL_FRONT_AND_BACK,GL_AMBIENT_AND_DIFFUSE).
+//  Point lights are added from the fragment's cluster (see cluster.c).
+//  Light 0 is shadowed by the shadow map (see shadow.c).
+//  SHADOWS and POINT_LIGHTS compile those features in (see shader.c).
+#version 120
+#extension GL_ARB_uniform_buffer_object : require
+
+struct material_t
+{
+   vec4 Specular;
+   vec4 Emission;
+   vec4 Shininess;  //  x is the shininess
+};
+
+//  Updated once per frame
+layout(std140) uniform Light
+{
+   vec4 LightPosition;  //  Eye coordinates
+   vec4 LightAmbient;
+   vec4 LightDiffuse;
+   vec4 LightSpecular;
+   vec4 GlobalAmbient;
+};
+
+//  Updated when a material is added
+layout(std140) uniform Materials
+{
+   material_t Mat[256];
+};
+
+uniform int Material;   //  Material of this draw
+uniform int Textured;   //  Modulate by the texture
+uniform sampler2D Tex;  //  Texture
+uniform sampler2DShadow Shadow;  //  Shadow map of light 0
+uniform int Shadows;             //  Use the shadow map
+
+//  Clustered point lights
+uniform sampler2D LightTex;    //  View position and radius, then color
+uniform sampler2D ClusterTex;  //  First index and count of each cluster
+uniform sampler2D IndexTex;    //  Light numbers
+uniform float LightWidth;      //  Width of LightTex
+uniform vec2 IndexSize;        //  Size of IndexTex
+uniform vec3 ClusterSize;      //  Tiles across and down and depth slices
+uniform vec4 ClusterViewport;  //  Viewport the tiles divide
+uniform float ClusterNear;     //  Distance of the first slice
+uniform float ClusterScale;    //  Slices per log distance (negative for none)
+
+varying vec3 Position;
+varying vec3 Normal;
+varying vec4 ShadowCoord;
+
+void main()
+{
+   material_t M = Mat[Material];
+   vec3 N = normalize(Normal);
+   vec3 L = normalize(LightPosition.xyz - Position);
+   vec3 V = normalize(-Position);
+   vec3 H = normalize(L+V);
+   vec4 C = gl_Color;
+   float Id = max(dot(N,L),0.0);
+   float Is = Id>0.0 ? pow(max(dot(N,H),0.0),M.Shininess.x) : 0.0;
+   //  Outside the light's frustum is lit
+#ifdef SHADOWS
+   if (Shadows!=0 && ShadowCoord.w>0.0 && ShadowCoord.z<ShadowCoord.w)
+   {
+      float lit = shadow2DProj(Shadow,ShadowCoord).r;
+      Id *= lit;
+      Is *= lit;
+   }
+#endif
+   vec4 light = M.Emission
+              + GlobalAmbient*C
+              + LightAmbient*C
+              + LightDiffuse*C*Id
+              + LightSpecular*M.Specular*Is;
+#ifdef POINT_LIGHTS
+   //  Point lights in this fragment's cluster
+   vec2 tile = floor((gl_FragCoord.xy-ClusterViewport.xy)/ClusterViewport.zw*ClusterSize.xy);
+   tile = clamp(tile,vec2(0.0),ClusterSize.xy-1.0);
+   float slice = floor(log(-Position.z/ClusterNear)*ClusterScale);
+   if (slice>=0.0 && slice<ClusterSize.z)
+   {
+      vec2 cell = vec2(tile.x+tile.y*ClusterSize.x,slice);
+      vec2 list = texture2D(ClusterTex,(cell+0.5)/vec2(ClusterSize.x*ClusterSize.y,ClusterSize.z)).rg;
+      for (float i=list.x;i<list.x+list.y;i++)
+      {
+         vec2 at = vec2(mod(i,IndexSize.x),floor(i/IndexSize.x));
+         float k = (texture2D(IndexTex,(at+0.5)/IndexSize).r+0.5)/LightWidth;
+         vec4 P = texture2D(LightTex,vec2(k,0.25));
+         vec3 Lp = P.xyz-Position;
+         float d = length(Lp);
+         //  Falls smoothly to zero at the radius
+         float f = clamp(1.0-d*d/(P.w*P.w),0.0,1.0);
+         if (f>0.0)
+         {
+            vec3 Cp = texture2D(LightTex,vec2(k,0.75)).rgb*f*f;
+            Lp /= d;
+            float Ip = max(dot(N,Lp),0.0);
+            float Sp = Ip>0.0 ? pow(max(dot(N,normalize(Lp+V)),0.0),M.Shininess.x) : 0.0;
+            light.rgb += Cp*(C.rgb*Ip + M.Specular.rgb*Sp);
+         }
+      }
+   }
+#endif
+   vec4 color = vec4(clamp(light.rgb,0.0,1.0),C.a);
+   if (Textured!=0) color *= texture2D(Tex,gl_TexCoord[0].st);
+   gl_FragColor = color;
+}
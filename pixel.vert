@@ -0,0 +1,19 @@
+//  Per pixel lighting vertex shader
+//  Passes eye coordinates on to pixel.frag
+#version 120
+
+varying vec3 Position;  //  Eye coordinates
+varying vec3 Normal;    //  Eye normal
+varying vec4 ShadowCoord;  //  Shadow map coordinates
+
+uniform mat4 ShadowMatrix;  //  Eye to shadow map coordinates
+
+void main()
+{
+   Position = vec3(gl_ModelViewMatrix * gl_Vertex);
+   Normal = gl_NormalMatrix * gl_Normal;
+   ShadowCoord = ShadowMatrix * vec4(Position,1.0);
+   gl_FrontColor = gl_Color;
+   gl_TexCoord[0] = gl_MultiTexCoord0;
+   gl_Position = ftransform();
+}
@@ -6,8 +6,104 @@
 //  Convenience routine to output raster text
 //  Use VARARGS to make this more flexible
 //
+//  Until PrintInit is called each character is a glutBitmapCharacter.
+//  PrintInit draws the font once into an atlas texture, after which
+//  Print only adds a quad per character at the current raster position
+//  and in the current raster color, and PrintFlush draws every quad of
+//  the frame from the stream ring in one call.  Text is drawn on top of
+//  the frame when it is flushed rather than depth tested where it is
+//  printed.
+//
+
+#define LEN 8192                        //  Maximum length of text string
+#define FONT GLUT_BITMAP_HELVETICA_18   //  Font
+#define CELL 24                         //  Atlas cell size in pixels
+#define PAD  3                          //  Cell left of the glyph origin
+#define DESC 6                          //  Cell below the baseline
+#define COLS 16                         //  Atlas cells across
+#define FIRST 32                        //  First and last characters in the atlas
+#define LAST  126
+#define ROWS ((LAST-FIRST)/COLS+1)
+
+typedef struct
+{
+   float x,y,s,t;
+   unsigned char r,g,b,a;
+} glyph_t;
+
+static unsigned int atlas=0;      //  Font texture (0 before PrintInit)
+static int advance[LAST+1];       //  Glyph widths in pixels
+static int box[LAST+1][4];        //  Inked part of each cell (x0,y0,x1,y1)
+static glyph_t* vtx=NULL;         //  Quads printed this frame
+static int Nvtx=0,Mvtx=0;
+
+//
+//  Draw the font into the atlas and batch text from now on
+//
+void PrintInit(void)
+{
+   int W=COLS*CELL,H=ROWS*CELL;
+   int fbo,vp[4];
+   glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING,&fbo);
+   glGetIntegerv(GL_VIEWPORT,vp);
+   //  RGBA texture cleared to transparent, glyphs are opaque white
+   glGenTextures(1,&atlas);
+   glBindTexture(GL_TEXTURE_2D,atlas);
+   glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,W,H,0,GL_RGBA,GL_UNSIGNED_BYTE,NULL);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+   glBindTexture(GL_TEXTURE_2D,0);
+   DebugLabel(GL_TEXTURE,atlas,"font atlas");
+   unsigned int fb;
+   glGenFramebuffers(1,&fb);
+   glBindFramebuffer(GL_FRAMEBUFFER,fb);
+   glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,atlas,0);
+   if (glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE) Fatal("Cannot draw the font atlas\n");
+   //  Draw each glyph with its origin PAD,DESC into its cell
+   glPushAttrib(GL_ENABLE_BIT|GL_COLOR_BUFFER_BIT|GL_CURRENT_BIT);
+   glDisable(GL_LIGHTING);
+   glDisable(GL_TEXTURE_2D);
+   glDisable(GL_DEPTH_TEST);
+   glDisable(GL_BLEND);
+   glViewport(0,0,W,H);
+   glClearColor(0,0,0,0);
+   glClear(GL_COLOR_BUFFER_BIT);
+   glColor4f(1,1,1,1);
+   for (int c=FIRST;c<=LAST;c++)
+   {
+      int k = c-FIRST;
+      glWindowPos2i(CELL*(k%COLS)+PAD,CELL*(k/COLS)+DESC);
+      glutBitmapCharacter(FONT,c);
+   }
+   for (int c=0;c<=LAST;c++)
+      advance[c] = glutBitmapWidth(FONT,c);
+   //  Quads only cover the inked pixels of each cell
+   unsigned char* img = (unsigned char*)malloc(W*H);
+   if (!img) Fatal("Cannot allocate font atlas image\n");
+   glReadPixels(0,0,W,H,GL_ALPHA,GL_UNSIGNED_BYTE,img);
+   for (int c=FIRST;c<=LAST;c++)
+   {
+      int k = c-FIRST;
+      int* b = box[c];
+      b[0] = b[1] = CELL;
+      b[2] = b[3] = 0;
+      for (int j=0;j<CELL;j++)
+         for (int i=0;i<CELL;i++)
+            if (img[(CELL*(k/COLS)+j)*W+CELL*(k%COLS)+i])
+            {
+               if (i<b[0]) b[0] = i;
+               if (j<b[1]) b[1] = j;
+               if (i>=b[2]) b[2] = i+1;
+               if (j>=b[3]) b[3] = j+1;
+            }
+   }
+   free(img);
+   glPopAttrib();
+   glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+   glDeleteFramebuffers(1,&fb);
+   glViewport(vp[0],vp[1],vp[2],vp[3]);
+}
 
-#define LEN 8192  //  Maximum length of text string
 void Print(const char* format , ...)
 {
    char    buf[LEN];
@@ -18,6 +114,107 @@ void Print(const char* format , ...)
    vsnprintf(buf,LEN,format,args);
    va_end(args);
    //  Display the characters one at a time at the current raster position
-   while (*ch)
-      glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18,*ch++);
+   if (!atlas)
+   {
+      while (*ch)
+         glutBitmapCharacter(FONT,*ch++);
+      return;
+   }
+   //  Nothing is drawn at an invalid raster position
+   int valid;
+   glGetIntegerv(GL_CURRENT_RASTER_POSITION_VALID,&valid);
+   if (!valid) return;
+   float pos[4],color[4];
+   glGetFloatv(GL_CURRENT_RASTER_POSITION,pos);
+   glGetFloatv(GL_CURRENT_RASTER_COLOR,color);
+   unsigned char rgba[4];
+   for (int i=0;i<4;i++)
+      rgba[i] = 255*color[i]+0.5;
+   int n = strlen(buf);
+   if (Nvtx+4*n > Mvtx)
+   {
+      while (Nvtx+4*n > Mvtx) Mvtx = Mvtx ? 2*Mvtx : 4096;
+      vtx = (glyph_t*)realloc(vtx,Mvtx*sizeof(glyph_t));
+      if (!vtx) Fatal("Cannot allocate %d text vertexes\n",Mvtx);
+   }
+   //  A quad over the atlas cell of each character, like glBitmap at the pen
+   float x = pos[0];
+   float y = floor(pos[1])-DESC;
+   for (;*ch;ch++)
+   {
+      int c = (unsigned char)*ch;
+      if (c>=FIRST && c<=LAST && box[c][2])
+      {
+         int k = c-FIRST;
+         int* b = box[c];
+         float x0 = floor(x)-PAD;
+         float s0 = (CELL*(k%COLS)+b[0])/(float)(COLS*CELL);
+         float t0 = (CELL*(k/COLS)+b[1])/(float)(ROWS*CELL);
+         float s1 = (CELL*(k%COLS)+b[2])/(float)(COLS*CELL);
+         float t1 = (CELL*(k/COLS)+b[3])/(float)(ROWS*CELL);
+         glyph_t* v = vtx+Nvtx;
+         v[0] = (glyph_t){x0+b[0],y+b[1],s0,t0,rgba[0],rgba[1],rgba[2],rgba[3]};
+         v[1] = (glyph_t){x0+b[2],y+b[1],s1,t0,rgba[0],rgba[1],rgba[2],rgba[3]};
+         v[2] = (glyph_t){x0+b[2],y+b[3],s1,t1,rgba[0],rgba[1],rgba[2],rgba[3]};
+         v[3] = (glyph_t){x0+b[0],y+b[3],s0,t1,rgba[0],rgba[1],rgba[2],rgba[3]};
+         Nvtx += 4;
+      }
+      if (c<=LAST) x += advance[c];
+   }
+   //  Move the raster position past the text as glutBitmapCharacter does
+   glBitmap(0,0,0,0,x-pos[0],0,NULL);
+}
+
+//
+//  Draw the text printed since the last flush
+//
+void PrintFlush(void)
+{
+   if (!Nvtx) return;
+   int vp[4],prog,unit;
+   glGetIntegerv(GL_VIEWPORT,vp);
+   glGetIntegerv(GL_CURRENT_PROGRAM,&prog);
+   glGetIntegerv(GL_ACTIVE_TEXTURE,&unit);
+   glUseProgram(0);
+   glActiveTexture(GL_TEXTURE0);
+   glPushAttrib(GL_ENABLE_BIT|GL_COLOR_BUFFER_BIT|GL_TEXTURE_BIT);
+   glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+   glDisable(GL_LIGHTING);
+   glDisable(GL_DEPTH_TEST);
+   glDisable(GL_CULL_FACE);
+   glDisable(GL_BLEND);
+   glEnable(GL_TEXTURE_2D);
+   //  Texels are opaque white or clear, so testing alpha copies the
+   //  color where the glyph is inked like glBitmap does
+   glEnable(GL_ALPHA_TEST);
+   glAlphaFunc(GL_GREATER,0.5);
+   glBindTexture(GL_TEXTURE_2D,atlas);
+   glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,GL_MODULATE);
+   glMatrixMode(GL_PROJECTION);
+   glPushMatrix();
+   glLoadIdentity();
+   glOrtho(vp[0],vp[0]+vp[2],vp[1],vp[1]+vp[3],-1,1);
+   glMatrixMode(GL_MODELVIEW);
+   glPushMatrix();
+   glLoadIdentity();
+   //  All quads in one draw from the stream ring
+   int off = StreamWrite(vtx,Nvtx*sizeof(glyph_t));
+   glBindBuffer(GL_ARRAY_BUFFER,StreamBuffer());
+   glEnableClientState(GL_VERTEX_ARRAY);
+   glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+   glEnableClientState(GL_COLOR_ARRAY);
+   glVertexPointer(2,GL_FLOAT,sizeof(glyph_t),(void*)(size_t)off);
+   glTexCoordPointer(2,GL_FLOAT,sizeof(glyph_t),(void*)(size_t)(off+offsetof(glyph_t,s)));
+   glColorPointer(4,GL_UNSIGNED_BYTE,sizeof(glyph_t),(void*)(size_t)(off+offsetof(glyph_t,r)));
+   glDrawArrays(GL_QUADS,0,Nvtx);
+   glBindBuffer(GL_ARRAY_BUFFER,0);
+   glMatrixMode(GL_PROJECTION);
+   glPopMatrix();
+   glMatrixMode(GL_MODELVIEW);
+   glPopMatrix();
+   glPopClientAttrib();
+   glPopAttrib();
+   glActiveTexture(unit);
+   glUseProgram(prog);
+   Nvtx = 0;
 }
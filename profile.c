@@ -0,0 +1,236 @@
+//  CSCIx229 library
+//  Nested CPU and GPU scope timers with an on screen chart
+#include "CSCIx229.h"
+
+//
+//  ProfileBegin and ProfileEnd bracket a named scope, and scopes nest.
+//  Each scope is timed on the CPU with Timer and on the GPU with a pair
+//  of GL_TIMESTAMP queries; GL_TIME_ELAPSED queries cannot be nested or
+//  overlap the shadow map's own timer, timestamps can.  A scope is a name
+//  inside an enclosing scope, so the same name under two parents is two
+//  scopes, and calls to one scope in a frame add up.
+//
+//  Queries are kept in FRAMES sets, one per frame.  ProfileFrame reads
+//  the set it is about to reuse, issued FRAMES-1 frames ago, and only
+//  if the GPU is done with it, so reading never stalls.  The CPU times
+//  shown are from the last frame and the GPU times from that older one.
+//
+//  ProfileDraw charts the scopes as a tree of bars, CPU above GPU.
+//  Scopes are also debug groups in GLDEBUG builds, profiling or not.
+//
+
+#define MAXSCOPE 64    //  Named scopes
+#define MAXDEPTH 16    //  Deepest nesting
+#define MAXQUERY 2048  //  Timestamp queries per frame
+#define FRAMES   3     //  Query sets in flight
+
+typedef struct
+{
+   const char* name;  //  Scope name
+   int parent;        //  Enclosing scope (-1 for none)
+   int calls;         //  Calls in the last frame
+   double cpu,gpu;    //  Milliseconds in the last frame read
+   double sum;        //  Seconds so far in this frame
+   int count;         //  Calls so far in this frame
+} scope_t;
+
+typedef struct
+{
+   int scope;  //  Scope timed
+   int q0,q1;  //  Start and end timestamp queries
+} mark_t;
+
+static int on=0;                           //  Profiling enabled
+static scope_t scope[MAXSCOPE];            //  Scopes in order of first use
+static int Nscope=0;
+static int stack[MAXDEPTH];                //  Open scopes
+static double start[MAXDEPTH];             //  CPU start of the open scopes
+static int qstart[MAXDEPTH];               //  Start query of the open scopes (-1 for none)
+static int depth=0;                        //  Number of open scopes
+static unsigned int query[FRAMES][MAXQUERY];
+static mark_t mark[FRAMES][MAXQUERY/2];    //  Scopes timed in each set
+static int Nquery[FRAMES],Nmark[FRAMES];
+static int frame=0;                        //  Set in use is frame%FRAMES
+static int late=0;                         //  Sets not ready when reused
+
+//
+//  Enable (1) or disable (0) profiling
+//
+void ProfileMode(int enable)
+{
+   on = enable;
+   depth = 0;
+}
+
+//
+//  Start a frame
+//    closes the CPU times of the last frame and reads the GPU times of
+//    the oldest frame if they are ready
+//
+void ProfileFrame(void)
+{
+   if (!on) return;
+   for (int k=0;k<Nscope;k++)
+   {
+      scope[k].cpu   = 1000*scope[k].sum;
+      scope[k].calls = scope[k].count;
+      scope[k].sum   = 0;
+      scope[k].count = 0;
+   }
+   //  Scopes left open are dropped
+   depth = 0;
+   int f = ++frame%FRAMES;
+   if (Nmark[f])
+   {
+      //  Timestamps complete in order, so the last one decides
+      int ready;
+      glGetQueryObjectiv(query[f][Nquery[f]-1],GL_QUERY_RESULT_AVAILABLE,&ready);
+      if (ready)
+      {
+         for (int k=0;k<Nscope;k++)
+            scope[k].gpu = 0;
+         for (int k=0;k<Nmark[f];k++)
+         {
+            GLuint64 t0,t1;
+            glGetQueryObjectui64v(query[f][mark[f][k].q0],GL_QUERY_RESULT,&t0);
+            glGetQueryObjectui64v(query[f][mark[f][k].q1],GL_QUERY_RESULT,&t1);
+            scope[mark[f][k].scope].gpu += 1e-6*(t1-t0);
+         }
+      }
+      else
+         late++;
+   }
+   Nquery[f] = Nmark[f] = 0;
+}
+
+//
+//  Open the scope called name
+//    name must stay valid while the program runs
+//
+void ProfileBegin(const char* name)
+{
+   DebugPush(name);
+   if (!on) return;
+   if (depth>=MAXDEPTH) Fatal("Profile scopes nested deeper than %d\n",MAXDEPTH);
+   if (!query[0][0]) glGenQueries(FRAMES*MAXQUERY,query[0]);
+   int parent = depth ? stack[depth-1] : -1;
+   int k;
+   for (k=0;k<Nscope;k++)
+      if (scope[k].parent==parent && (scope[k].name==name || !strcmp(scope[k].name,name))) break;
+   if (k==Nscope)
+   {
+      if (Nscope>=MAXSCOPE) Fatal("Too many profile scopes\n");
+      memset(scope+k,0,sizeof(scope_t));
+      scope[k].name = name;
+      scope[k].parent = parent;
+      Nscope++;
+   }
+   //  Only start a GPU timer if the ends of all open scopes still fit
+   int f = frame%FRAMES;
+   qstart[depth] = -1;
+   if (Nquery[f]+2*(depth+1)<=MAXQUERY)
+   {
+      qstart[depth] = Nquery[f];
+      glQueryCounter(query[f][Nquery[f]++],GL_TIMESTAMP);
+   }
+   stack[depth] = k;
+   start[depth] = Timer();
+   depth++;
+}
+
+//
+//  Close the innermost open scope
+//
+void ProfileEnd(void)
+{
+   DebugPop();
+   if (!on || !depth) return;
+   depth--;
+   int k = stack[depth];
+   scope[k].sum += Timer()-start[depth];
+   scope[k].count++;
+   if (qstart[depth]>=0)
+   {
+      int f = frame%FRAMES;
+      mark_t* m = &mark[f][Nmark[f]++];
+      m->scope = k;
+      m->q0 = qstart[depth];
+      m->q1 = Nquery[f];
+      glQueryCounter(query[f][Nquery[f]++],GL_TIMESTAMP);
+   }
+}
+
+//
+//  Chart scope k and its children from row *row down
+//    x is the left edge, w the width of the longest bar, ms its time
+//
+static void ProfileRow(int k,int lvl,int* row,int x,int y,int w,double ms)
+{
+   scope_t* s = scope+k;
+   int yr = y-18*(*row)++;
+   int cw = ms>0 ? w*s->cpu/ms : 0;
+   int gw = ms>0 ? w*s->gpu/ms : 0;
+   glBegin(GL_QUADS);
+   glColor3f(1,0.6,0.1);
+   glVertex2i(x+200,yr+8);
+   glVertex2i(x+200+cw,yr+8);
+   glVertex2i(x+200+cw,yr+14);
+   glVertex2i(x+200,yr+14);
+   glColor3f(0.2,0.8,1);
+   glVertex2i(x+200,yr+1);
+   glVertex2i(x+200+gw,yr+1);
+   glVertex2i(x+200+gw,yr+7);
+   glVertex2i(x+200,yr+7);
+   glEnd();
+   glColor3f(1,1,1);
+   glWindowPos2i(x+10*lvl,yr);
+   if (s->calls>1)
+      Print("%s x%d %.2f/%.2f",s->name,s->calls,s->cpu,s->gpu);
+   else
+      Print("%s %.2f/%.2f",s->name,s->cpu,s->gpu);
+   for (int i=k+1;i<Nscope;i++)
+      if (scope[i].parent==k) ProfileRow(i,lvl+1,row,x,y,w,ms);
+}
+
+//
+//  Chart the scopes at the top right of the viewport
+//    each row is the scope name, CPU/GPU milliseconds, and bars on a
+//    shared scale with the CPU time orange over the GPU time blue
+//
+void ProfileDraw(void)
+{
+   if (!on || !Nscope) return;
+   int vp[4],prog;
+   glGetIntegerv(GL_VIEWPORT,vp);
+   glGetIntegerv(GL_CURRENT_PROGRAM,&prog);
+   glUseProgram(0);
+   glPushAttrib(GL_ENABLE_BIT|GL_CURRENT_BIT);
+   glDisable(GL_LIGHTING);
+   glDisable(GL_TEXTURE_2D);
+   glDisable(GL_DEPTH_TEST);
+   glDisable(GL_BLEND);
+   glMatrixMode(GL_PROJECTION);
+   glPushMatrix();
+   glLoadIdentity();
+   glOrtho(vp[0],vp[0]+vp[2],vp[1],vp[1]+vp[3],-1,1);
+   glMatrixMode(GL_MODELVIEW);
+   glPushMatrix();
+   glLoadIdentity();
+   //  Scale to the longest top level scope
+   double ms = 0;
+   for (int k=0;k<Nscope;k++)
+      if (scope[k].parent<0) ms = fmax(ms,fmax(scope[k].cpu,scope[k].gpu));
+   int x = vp[0]+vp[2]-360;
+   int y = vp[1]+vp[3]-20;
+   glWindowPos2i(x,y);
+   Print("Profile(P) cpu/gpu ms, %d late",late);
+   int row = 1;
+   for (int k=0;k<Nscope;k++)
+      if (scope[k].parent<0) ProfileRow(k,0,&row,x,y,150,ms);
+   glMatrixMode(GL_PROJECTION);
+   glPopMatrix();
+   glMatrixMode(GL_MODELVIEW);
+   glPopMatrix();
+   glPopAttrib();
+   glUseProgram(prog);
+}
@@ -0,0 +1,316 @@
+//  CSCIx229 library
+//  Render queue sorted on state keys
+#include "CSCIx229.h"
+
+//
+//  Draws are submitted with the state they need (pass, program, texture
+//  and material) instead of setting it themselves.  RenderFlush sorts
+//  them on a 64 bit key and runs them, changing GL state only where it
+//  differs from the previous draw.
+//
+//  With RenderLighting on, fixed function draws that do not set their own
+//  state are drawn with the per pixel lighting shader instead, and a
+//  material change is just the index of the material in its buffer.
+//  A draw that binds its own program, like an instanced draw, gets the
+//  number of its material from RenderDrawMaterial rather than from
+//  glMaterial state, which the queue then no longer sets.
+//
+//  Key layout, most significant first
+//    opaque, OIT  pass:4 program:12 texture:12 material:12 depth:24
+//    additive     pass:4 depth:24 program:12 texture:12 material:12
+//  Opaque draws are grouped by state and go front to back within a
+//  group; additive draws go back to front.  The order independent pass
+//  needs no order so it is grouped by state like opaque.  Program and texture
+//  names are truncated to 12 bits, so two names can share a group, which
+//  only costs a state change.
+//
+
+#define MAXMAT 256  //  Maximum number of materials
+
+typedef struct
+{
+   float specular[4];
+   float shininess;
+   float emission[4];
+} material_t;
+
+typedef struct
+{
+   unsigned long long key;  //  Sort key
+   rstate_t state;          //  State for the draw
+   scenedraw_t draw;        //  Draw function
+   int arg;                 //  Argument passed to draw
+} item_t;
+
+static material_t mat[MAXMAT];
+static int Nmat=0;
+static item_t* item=NULL;   //  Queued draws
+static int Nitem=0,Mitem=0;  //  Queued draw count and capacity
+static float eye[3];         //  Eye position for depth
+static float farz=1;         //  Distance mapped to the largest depth
+static int changes=0,eliminated=0,draws=0;  //  Counts from the last RenderFlush
+static unsigned int timer[2];        //  Transparent pass timer queries
+static int timing[2]={0,0};          //  Timer query issued and not yet read
+static int frame=0;                  //  RenderFlush calls
+static double transparentTime=0;     //  Milliseconds in the transparent pass
+static int lighting=0;               //  Per pixel lighting shader (0 for fixed function)
+static int locMaterial,locTextured;  //  Its uniforms
+static int drawMaterial=0;           //  Material of the draw running (0 for none)
+
+//
+//  Return the number of a material, adding it if it is new
+//
+int RenderMaterial(const float specular[4],float shininess,const float emission[4])
+{
+   material_t m;
+   memcpy(m.specular,specular,sizeof(m.specular));
+   m.shininess = shininess;
+   memcpy(m.emission,emission,sizeof(m.emission));
+   for (int k=0;k<Nmat;k++)
+      if (!memcmp(mat+k,&m,sizeof(m))) return k+1;
+   if (Nmat>=MAXMAT) Fatal("Too many render materials\n");
+   LightingMaterial(Nmat,specular,shininess,emission);
+   mat[Nmat++] = m;
+   return Nmat;
+}
+
+//
+//  Set fixed function material k (numbered from 1 as RenderMaterial does)
+//
+void RenderMaterialFixed(int k)
+{
+   if (k<1 || k>Nmat) return;
+   const material_t* m = mat+k-1;
+   glMaterialfv(GL_FRONT_AND_BACK,GL_SPECULAR,m->specular);
+   glMaterialf(GL_FRONT_AND_BACK,GL_SHININESS,m->shininess);
+   glMaterialfv(GL_FRONT,GL_EMISSION,m->emission);
+}
+
+//
+//  Return the material of the draw RenderFlush is running (0 for none)
+//
+int RenderDrawMaterial(void)
+{
+   return drawMaterial;
+}
+
+//
+//  Draw with the per pixel lighting shader or fixed function lighting
+//
+void RenderLighting(int on)
+{
+   lighting = on ? LightingProgram() : 0;
+   if (lighting)
+   {
+      locMaterial = glGetUniformLocation(lighting,"Material");
+      locTextured = glGetUniformLocation(lighting,"Textured");
+   }
+}
+
+//
+//  Start a frame
+//    call with the view matrix as the modelview, which the draws run with
+//    the eye and far plane for the depth come from the current matrices
+//
+void RenderBegin(void)
+{
+   float P[16],V[16];
+   glGetFloatv(GL_PROJECTION_MATRIX,P);
+   glGetFloatv(GL_MODELVIEW_MATRIX,V);
+   for (int i=0;i<3;i++)
+      eye[i] = -(V[4*i]*V[12] + V[4*i+1]*V[13] + V[4*i+2]*V[14]);
+   farz = P[15]==0 ? P[14]/(P[10]+1) : 1;
+   Nitem = 0;
+}
+
+//
+//  Queue a draw at world position x,y,z
+//
+void RenderSubmit(const rstate_t* s,double x,double y,double z,scenedraw_t draw,int arg)
+{
+   if (Nitem>=Mitem)
+   {
+      Mitem = Mitem ? 2*Mitem : 256;
+      item = (item_t*)realloc(item,Mitem*sizeof(item_t));
+      if (!item) Fatal("Cannot allocate %d render queue entries\n",Mitem);
+   }
+   //  Depth as a 24 bit fraction of the far distance
+   double dx=x-eye[0],dy=y-eye[1],dz=z-eye[2];
+   double d = sqrt(dx*dx+dy*dy+dz*dz)/farz;
+   unsigned long long depth = (d<0 ? 0 : d>1 ? 1 : d)*0xFFFFFF;
+   unsigned long long state = ((unsigned long long)(s->program&0xFFF)<<24) |
+                              ((unsigned long long)(s->texture&0xFFF)<<12) |
+                              (s->material&0xFFF);
+   item_t* it = item+Nitem++;
+   it->state = *s;
+   it->draw  = draw;
+   it->arg   = arg;
+   if (s->pass!=RENDER_ADDITIVE)
+      it->key = ((unsigned long long)s->pass<<60) | (state<<24) | depth;
+   else
+      it->key = ((unsigned long long)s->pass<<60) | ((0xFFFFFF-depth)<<36) | state;
+}
+
+//
+//  Order for qsort
+//
+static int RenderCompare(const void* a,const void* b)
+{
+   unsigned long long ka = ((const item_t*)a)->key;
+   unsigned long long kb = ((const item_t*)b)->key;
+   return ka<kb ? -1 : ka>kb ? +1 : 0;
+}
+
+//
+//  Change from pass p to pass q
+//
+static void RenderPass(int p,int q)
+{
+   if (p==RENDER_OIT)
+      OITEnd();
+   if (q==RENDER_ADDITIVE)
+   {
+      glEnable(GL_BLEND);
+      glBlendFunc(GL_SRC_ALPHA,GL_ONE);
+      glDepthMask(0);
+   }
+   else
+   {
+      glDisable(GL_BLEND);
+      glDepthMask(1);
+   }
+   if (q==RENDER_OIT)
+      OITBegin();
+}
+
+//
+//  Time the transparent passes with a timer query
+//    two queries alternate and a result is only read once it is
+//    available, so the time shown is from an earlier frame
+//
+static void RenderTimer(int start)
+{
+   int k = frame%2;
+   if (start)
+   {
+      if (!timer[0]) glGenQueries(2,timer);
+      if (timing[k])
+      {
+         int ready;
+         glGetQueryObjectiv(timer[k],GL_QUERY_RESULT_AVAILABLE,&ready);
+         if (!ready) return;
+         GLuint64 ns;
+         glGetQueryObjectui64v(timer[k],GL_QUERY_RESULT,&ns);
+         transparentTime = 1e-6*ns;
+      }
+      glBeginQuery(GL_TIME_ELAPSED,timer[k]);
+      timing[k] = 2;
+   }
+   else if (timing[k]==2)
+   {
+      glEndQuery(GL_TIME_ELAPSED);
+      timing[k] = 1;
+   }
+}
+
+//
+//  Sort and run the queued draws
+//    every draw sets pass, program, texture and material (unless it is
+//    0), so eliminated counts the ones that matched the current state
+//
+void RenderFlush(void)
+{
+   qsort(item,Nitem,sizeof(item_t),RenderCompare);
+   //  -1 forces the first draw to set everything
+   rstate_t cur = {-1,-1,-1,-1,0};
+   changes = eliminated = 0;
+   draws = Nitem;
+   //  Instanced draws read the materials whichever path is lighting
+   LightingMaterials();
+   for (int k=0;k<Nitem;k++)
+   {
+      rstate_t lit = item[k].state;
+      const rstate_t* s = &lit;
+      //  The lighting shader replaces fixed function lighting
+      if (lighting && !lit.program && !lit.dirty && lit.pass!=RENDER_OIT) lit.program = lighting;
+      if (s->pass != cur.pass)
+      {
+         if (s->pass!=RENDER_OPAQUE && cur.pass<=RENDER_OPAQUE) RenderTimer(1);
+         RenderPass(cur.pass,s->pass);
+         //  The OIT composite leaves no program bound
+         if (cur.pass==RENDER_OIT) cur.program = -1;
+         changes++;
+      }
+      else
+         eliminated++;
+      if (s->program != cur.program)
+      {
+         glUseProgram(s->program);
+         //  Materials and textures are set differently for the lighting shader
+         if (lighting && (s->program==lighting || cur.program==lighting))
+            cur.texture = cur.material = -1;
+         changes++;
+      }
+      else
+         eliminated++;
+      if (s->texture != cur.texture)
+      {
+         if (s->texture)
+         {
+            glEnable(GL_TEXTURE_2D);
+            glBindTexture(GL_TEXTURE_2D,s->texture);
+         }
+         else
+            glDisable(GL_TEXTURE_2D);
+         if (lighting && s->program==lighting) glUniform1i(locTextured,s->texture!=0);
+         changes++;
+      }
+      else
+         eliminated++;
+      if (s->material && s->material != cur.material)
+      {
+         if (lighting && s->program==lighting)
+            glUniform1i(locMaterial,s->material-1);
+         else
+            RenderMaterialFixed(s->material);
+         cur.material = s->material;
+         changes++;
+      }
+      else if (s->material)
+         eliminated++;
+      cur.pass    = s->pass;
+      cur.program = s->program;
+      cur.texture = s->texture;
+      drawMaterial = s->material;
+      item[k].draw(item[k].arg);
+      drawMaterial = 0;
+      //  The draw changed texture or material itself
+      if (s->dirty) cur.texture = cur.material = -1;
+   }
+   //  Leave the default state
+   RenderPass(cur.pass,RENDER_OPAQUE);
+   RenderTimer(0);
+   glUseProgram(0);
+   glDisable(GL_TEXTURE_2D);
+   Nitem = 0;
+   frame++;
+}
+
+//
+//  Return draws, state changes made and state changes eliminated in the
+//  last RenderFlush
+//
+void RenderStats(int* ndraw,int* nchange,int* neliminated)
+{
+   *ndraw       = draws;
+   *nchange     = changes;
+   *neliminated = eliminated;
+}
+
+//
+//  Return the GPU time of the transparent passes in milliseconds
+//
+double RenderTransparentTime(void)
+{
+   return transparentTime;
+}
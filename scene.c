@@ -0,0 +1,414 @@
+//  CSCIx229 library
+//  Scene graph with bounding volumes and view frustum culling
+#include "CSCIx229.h"
+
+//
+//  Nodes hold world space bounds and a draw function.  A node with a
+//  parent is only considered when its parent is visible, so the bounds
+//  of a group node must enclose its children, and parents must be added
+//  before their children.  SceneCull tests every enabled node against
+//  the frustum; SceneDraw then calls the visible nodes in the order they
+//  were added.
+//
+//  Nodes marked with SceneOcclusion are also tested with occlusion
+//  queries.  After the scene is drawn SceneQuery draws the bounding box
+//  of each such node into the depth buffer with an asynchronous query.
+//  The result is collected by a later SceneCull once it is available, so
+//  the CPU never waits on the GPU; a node whose box produced no samples
+//  is skipped until a new query finds it visible again.
+//
+
+typedef struct
+{
+   const char* name;  //  Name for debugging
+   scenedraw_t draw;  //  Draw function (NULL for a group)
+   int arg;           //  Argument passed to draw
+   int parent;        //  Parent node (-1 for none)
+   int enabled;       //  Considered for drawing
+   bounds_t bounds;   //  World space bounds
+   int occlude;       //  Tested with occlusion queries
+   int hidden;        //  Last query found no samples
+   unsigned int query;  //  Query object (0 until first used)
+   int pending;       //  Query issued and not yet collected
+   int issued;        //  Frame the pending query was issued
+} node_t;
+
+static node_t* node=NULL;   //  Nodes
+static int Nnode=0,Mnode=0;  //  Node count and capacity
+static unsigned char* visible=NULL;  //  Visibility from the last SceneCull
+static int drawn=0,culled=0;         //  Counts from the last SceneCull
+static double cullTime=0;            //  Seconds spent in the last SceneCull
+static int occlusion=1;              //  Occlusion queries enabled
+static int frame=0;                  //  SceneQuery calls
+static int occluded=0,queries=0;     //  Skipped nodes and queries issued
+static int waiting=0;                //  Queries not yet available
+static int latencySum=0,latencyN=0;  //  Frames from issue to collection
+
+//
+//  Bounds of an axis aligned box
+//
+void BoundsBox(bounds_t* b,double x0,double y0,double z0,double x1,double y1,double z1)
+{
+   b->min[0] = x0;  b->max[0] = x1;
+   b->min[1] = y0;  b->max[1] = y1;
+   b->min[2] = z0;  b->max[2] = z1;
+   for (int k=0;k<3;k++)
+      b->center[k] = (b->min[k]+b->max[k])/2;
+   b->radius = sqrt((x1-x0)*(x1-x0)+(y1-y0)*(y1-y0)+(z1-z0)*(z1-z0))/2;
+}
+
+//
+//  Bounds of a sphere
+//
+void BoundsSphere(bounds_t* b,double x,double y,double z,double r)
+{
+   BoundsBox(b,x-r,y-r,z-r,x+r,y+r,z+r);
+   b->radius = r;
+}
+
+//
+//  Transform bounds by a column major matrix
+//    The box is the box around the transformed box and the sphere
+//    radius is scaled by the largest axis scale
+//
+void BoundsTransform(bounds_t* out,const bounds_t* in,const float M[16])
+{
+   bounds_t b;
+   for (int i=0;i<3;i++)
+   {
+      b.min[i] = b.max[i] = M[12+i];
+      b.center[i] = M[12+i];
+      for (int j=0;j<3;j++)
+      {
+         double e = M[4*j+i]*in->min[j];
+         double f = M[4*j+i]*in->max[j];
+         b.min[i] += e<f ? e : f;
+         b.max[i] += e<f ? f : e;
+         b.center[i] += M[4*j+i]*in->center[j];
+      }
+   }
+   double s = 0;
+   for (int j=0;j<3;j++)
+   {
+      double l = sqrt(M[4*j]*M[4*j]+M[4*j+1]*M[4*j+1]+M[4*j+2]*M[4*j+2]);
+      if (l>s) s = l;
+   }
+   b.radius = s*in->radius;
+   *out = b;
+}
+
+//
+//  Bounds of the vertexes of a mesh (which must still have its CPU copy)
+//
+void BoundsMesh(bounds_t* b,const mesh_t* m)
+{
+   if (!m->nv)
+   {
+      BoundsSphere(b,0,0,0,0);
+      return;
+   }
+   double x0=m->v[0].x,y0=m->v[0].y,z0=m->v[0].z;
+   double x1=x0,y1=y0,z1=z0;
+   for (int k=1;k<m->nv;k++)
+   {
+      const vtx_t* v = m->v+k;
+      x0 = fmin(x0,v->x);  x1 = fmax(x1,v->x);
+      y0 = fmin(y0,v->y);  y1 = fmax(y1,v->y);
+      z0 = fmin(z0,v->z);  z1 = fmax(z1,v->z);
+   }
+   BoundsBox(b,x0,y0,z0,x1,y1,z1);
+}
+
+//
+//  Set the frustum planes from the current projection and modelview
+//  Planes point inwards and are normalized
+//
+void FrustumFromGL(frustum_t* f)
+{
+   float P[16],V[16],C[16];
+   glGetFloatv(GL_PROJECTION_MATRIX,P);
+   glGetFloatv(GL_MODELVIEW_MATRIX,V);
+   //  Clip matrix C = P*V (column major)
+   for (int c=0;c<4;c++)
+      for (int r=0;r<4;r++)
+         C[4*c+r] = P[r]*V[4*c] + P[4+r]*V[4*c+1] + P[8+r]*V[4*c+2] + P[12+r]*V[4*c+3];
+   //  Rows of C combined as left, right, bottom, top, near, far
+   for (int k=0;k<6;k++)
+   {
+      int row = k/2;
+      double sign = k%2 ? -1 : +1;
+      double len = 0;
+      for (int i=0;i<4;i++)
+         f->plane[k][i] = C[4*i+3] + sign*C[4*i+row];
+      for (int i=0;i<3;i++)
+         len += f->plane[k][i]*f->plane[k][i];
+      len = sqrt(len);
+      for (int i=0;i<4;i++)
+         f->plane[k][i] /= len;
+   }
+}
+
+//
+//  Return true when the bounds may be inside the frustum
+//  The sphere test rejects most objects; the box test refines the rest
+//
+int FrustumTest(const frustum_t* f,const bounds_t* b)
+{
+   int inside = 1;
+   for (int k=0;k<6;k++)
+   {
+      const float* p = f->plane[k];
+      double d = p[0]*b->center[0] + p[1]*b->center[1] + p[2]*b->center[2] + p[3];
+      if (d < -b->radius) return 0;
+      if (d < b->radius) inside = 0;
+   }
+   //  Sphere entirely inside
+   if (inside) return 1;
+   //  Box corner furthest along each plane normal
+   for (int k=0;k<6;k++)
+   {
+      const float* p = f->plane[k];
+      double x = p[0]>0 ? b->max[0] : b->min[0];
+      double y = p[1]>0 ? b->max[1] : b->min[1];
+      double z = p[2]>0 ? b->max[2] : b->min[2];
+      if (p[0]*x + p[1]*y + p[2]*z + p[3] < 0) return 0;
+   }
+   return 1;
+}
+
+//
+//  Add a node and return its number
+//    draw may be NULL for a group node
+//    parent is -1 for none
+//
+int SceneAdd(const char* name,scenedraw_t draw,int arg,int parent,const bounds_t* bounds)
+{
+   if (parent>=Nnode) Fatal("Scene node %s added before its parent %d\n",name,parent);
+   if (Nnode>=Mnode)
+   {
+      Mnode = Mnode ? 2*Mnode : 256;
+      node = (node_t*)realloc(node,Mnode*sizeof(node_t));
+      visible = (unsigned char*)realloc(visible,Mnode);
+      if (!node || !visible) Fatal("Cannot allocate %d scene nodes\n",Mnode);
+   }
+   node_t* n = node+Nnode;
+   n->name    = name;
+   n->draw    = draw;
+   n->arg     = arg;
+   n->parent  = parent;
+   n->enabled = 1;
+   n->bounds  = *bounds;
+   n->occlude = 0;
+   n->hidden  = 0;
+   n->query   = 0;
+   n->pending = 0;
+   visible[Nnode] = 0;
+   return Nnode++;
+}
+
+//
+//  Update the world space bounds of a moving node
+//
+void SceneMove(int id,const bounds_t* bounds)
+{
+   if (id<0 || id>=Nnode) Fatal("Invalid scene node %d\n",id);
+   node[id].bounds = *bounds;
+}
+
+//
+//  Enable or disable a node (and so its children)
+//
+void SceneEnable(int id,int on)
+{
+   if (id<0 || id>=Nnode) Fatal("Invalid scene node %d\n",id);
+   node[id].enabled = on;
+}
+
+//
+//  Mark a node to be tested with occlusion queries
+//    group nodes may be marked too, which skips all their children
+//
+void SceneOcclusion(int id,int on)
+{
+   if (id<0 || id>=Nnode) Fatal("Invalid scene node %d\n",id);
+   node[id].occlude = on;
+   node[id].hidden  = 0;
+}
+
+//
+//  Enable or disable occlusion queries for the whole scene
+//
+void SceneOcclusionMode(int on)
+{
+   occlusion = on;
+   for (int k=0;k<Nnode;k++)
+      node[k].hidden = 0;
+}
+
+//
+//  Collect the occlusion query results that are ready without waiting
+//
+static void SceneCollect(void)
+{
+   waiting = 0;
+   for (int k=0;k<Nnode;k++)
+   {
+      node_t* n = node+k;
+      if (!n->pending) continue;
+      int ready;
+      glGetQueryObjectiv(n->query,GL_QUERY_RESULT_AVAILABLE,&ready);
+      if (!ready)
+      {
+         waiting++;
+         continue;
+      }
+      unsigned int samples;
+      glGetQueryObjectuiv(n->query,GL_QUERY_RESULT,&samples);
+      n->hidden  = occlusion && samples==0;
+      n->pending = 0;
+      latencySum += frame-n->issued;
+      latencyN++;
+   }
+}
+
+//
+//  Decide which nodes are visible in the frustum
+//    f may be NULL to skip culling
+//    visible is 0 for disabled, 1 for visible, 2 for culled and 3 for
+//    occluded, and the children of a culled or occluded node share its
+//    state without a test
+//
+void SceneCull(const frustum_t* f)
+{
+   double t0 = Timer();
+   SceneCollect();
+   drawn = culled = occluded = 0;
+   for (int k=0;k<Nnode;k++)
+   {
+      node_t* n = node+k;
+      int p = n->parent>=0 ? visible[n->parent] : 1;
+      if (!n->enabled || !p)
+         visible[k] = 0;
+      else if (p==2 || (f && !FrustumTest(f,&n->bounds)))
+         visible[k] = 2;
+      else if (p==3 || (occlusion && n->occlude && n->hidden))
+         visible[k] = 3;
+      else
+         visible[k] = 1;
+      if (n->draw && visible[k]==1) drawn++;
+      if (n->draw && visible[k]==2) culled++;
+      if (n->draw && visible[k]==3) occluded++;
+   }
+   cullTime = Timer()-t0;
+}
+
+//
+//  Draw the nodes found visible by SceneCull
+//
+void SceneDraw(void)
+{
+   for (int k=0;k<Nnode;k++)
+      if (visible[k]==1 && node[k].draw)
+         node[k].draw(node[k].arg);
+}
+
+//
+//  Draw a box
+//
+static void SceneBox(const float* a,const float* b)
+{
+   glBegin(GL_QUADS);
+   glVertex3f(a[0],a[1],a[2]); glVertex3f(b[0],a[1],a[2]); glVertex3f(b[0],b[1],a[2]); glVertex3f(a[0],b[1],a[2]);
+   glVertex3f(a[0],a[1],b[2]); glVertex3f(b[0],a[1],b[2]); glVertex3f(b[0],b[1],b[2]); glVertex3f(a[0],b[1],b[2]);
+   glVertex3f(a[0],a[1],a[2]); glVertex3f(a[0],b[1],a[2]); glVertex3f(a[0],b[1],b[2]); glVertex3f(a[0],a[1],b[2]);
+   glVertex3f(b[0],a[1],a[2]); glVertex3f(b[0],b[1],a[2]); glVertex3f(b[0],b[1],b[2]); glVertex3f(b[0],a[1],b[2]);
+   glVertex3f(a[0],a[1],a[2]); glVertex3f(b[0],a[1],a[2]); glVertex3f(b[0],a[1],b[2]); glVertex3f(a[0],a[1],b[2]);
+   glVertex3f(a[0],b[1],a[2]); glVertex3f(b[0],b[1],a[2]); glVertex3f(b[0],b[1],b[2]); glVertex3f(a[0],b[1],b[2]);
+   glEnd();
+}
+
+//
+//  Issue occlusion queries for the nodes tested this frame
+//    call after the opaque scene is drawn with the view matrix as the
+//    modelview, since the boxes are tested against its depth buffer
+//    boxes are grown a little so they are not hidden by the faces of
+//    the object they enclose, and a box around the eye is not tested
+//
+void SceneQuery(void)
+{
+   float P[16],V[16],eye[3];
+   glGetFloatv(GL_PROJECTION_MATRIX,P);
+   glGetFloatv(GL_MODELVIEW_MATRIX,V);
+   //  Eye is -R^T t and the near distance comes from the projection
+   for (int i=0;i<3;i++)
+      eye[i] = -(V[4*i]*V[12] + V[4*i+1]*V[13] + V[4*i+2]*V[14]);
+   double znear = P[15]==0 ? P[14]/(P[10]-1) : 0;
+
+   queries = 0;
+   frame++;
+   glPushAttrib(GL_ENABLE_BIT|GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+   glDisable(GL_LIGHTING);
+   glDisable(GL_TEXTURE_2D);
+   glDisable(GL_BLEND);
+   glDisable(GL_CULL_FACE);
+   glEnable(GL_DEPTH_TEST);
+   glColorMask(0,0,0,0);
+   glDepthMask(0);
+   for (int k=0;k<Nnode;k++)
+   {
+      node_t* n = node+k;
+      if (!n->occlude || n->pending) continue;
+      //  Not tested this frame, so assume visible when it comes back
+      if (!occlusion || (visible[k]!=1 && visible[k]!=3) || (n->parent>=0 && visible[n->parent]!=1))
+      {
+         n->hidden = 0;
+         continue;
+      }
+      float a[3],b[3];
+      int inside = 1;
+      for (int i=0;i<3;i++)
+      {
+         float grow = 0.01*(n->bounds.max[i]-n->bounds.min[i]) + 1e-3;
+         a[i] = n->bounds.min[i]-grow;
+         b[i] = n->bounds.max[i]+grow;
+         if (eye[i]<a[i]-znear || eye[i]>b[i]+znear) inside = 0;
+      }
+      if (inside)
+      {
+         n->hidden = 0;
+         continue;
+      }
+      if (!n->query) glGenQueries(1,&n->query);
+      glBeginQuery(GL_SAMPLES_PASSED,n->query);
+      SceneBox(a,b);
+      glEndQuery(GL_SAMPLES_PASSED);
+      n->pending = 1;
+      n->issued  = frame;
+      queries++;
+   }
+   glPopAttrib();
+}
+
+//
+//  Return the nodes skipped as occluded and queries issued in the last
+//  frame, the queries still waiting for a result and the mean number of
+//  frames from issuing a query to using its result
+//
+void SceneOcclusionStats(int* nskipped,int* nqueries,int* nwaiting,double* latency)
+{
+   *nskipped = occluded;
+   *nqueries = queries;
+   *nwaiting = waiting;
+   *latency  = latencyN ? (double)latencySum/latencyN : 0;
+   latencySum = latencyN = 0;
+}
+
+//
+//  Return drawn and culled node counts and the cull time in seconds
+//
+void SceneStats(int* ndrawn,int* nculled,double* seconds)
+{
+   *ndrawn  = drawn;
+   *nculled = culled;
+   *seconds = cullTime;
+}
@@ -0,0 +1,277 @@
+//  CSCIx229 library
+//  Shader programs with feature defines and a program binary cache
+#include "CSCIx229.h"
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir(dir,mode) _mkdir(dir)
+#else
+#include <sys/stat.h>
+#endif
+
+//
+//  ShaderProgram builds a program from a vertex and fragment shader
+//  file with a list of feature defines, so one source gives every
+//  permutation the program needs.  The defines go right after the
+//  #version line.
+//
+//  A linked program is saved with glGetProgramBinary in CACHE, named by
+//  a hash of both sources, the defines and the GL vendor, renderer and
+//  version, and later runs load it with glProgramBinary instead of
+//  compiling and linking.  A changed source or driver makes a new name;
+//  a binary the driver rejects is rebuilt from source and replaced.
+//
+
+#define CACHE "shadercache"  //  Cache directory
+#define MAGIC 0x42505347     //  Cache file magic
+
+typedef struct
+{
+   unsigned int magic;         //  MAGIC
+   unsigned int format;        //  Binary format
+   unsigned long long key;     //  Hash the file is named by
+   int length;                 //  Binary length in bytes
+} binhead_t;
+
+static int cache=-1;        //  Driver can save program binaries (-1 before the first program)
+static int Nprog=0;         //  Programs built
+static int Ncached=0;       //  Programs loaded from the cache
+static double seconds=0;    //  Time spent building programs
+
+//
+//  Read text file
+//
+static char* ReadText(const char* file)
+{
+   FILE* f = fopen(file,"rb");
+   if (!f) Fatal("Cannot open text file %s\n",file);
+   fseek(f,0,SEEK_END);
+   int n = ftell(f);
+   rewind(f);
+   char* buffer = (char*)malloc(n+1);
+   if (!buffer) Fatal("Cannot allocate %d bytes for text file %s\n",n+1,file);
+   if (n && fread(buffer,n,1,f)!=1) Fatal("Cannot read %d bytes for text file %s\n",n,file);
+   buffer[n] = 0;
+   fclose(f);
+   return buffer;
+}
+
+//
+//  Print the shader log and quit if it did not compile
+//
+static void ShaderLog(int obj,const char* file)
+{
+   int len=0;
+   glGetShaderiv(obj,GL_INFO_LOG_LENGTH,&len);
+   if (len>1)
+   {
+      char* buffer = (char*)malloc(len);
+      if (!buffer) Fatal("Cannot allocate %d bytes of text for shader log\n",len);
+      glGetShaderInfoLog(obj,len,NULL,buffer);
+      fprintf(stderr,"%s:\n%s\n",file,buffer);
+      free(buffer);
+   }
+   glGetShaderiv(obj,GL_COMPILE_STATUS,&len);
+   if (!len) Fatal("Error compiling %s\n",file);
+}
+
+//
+//  Print the program log and quit if it did not link
+//
+static void ProgramLog(int obj)
+{
+   int len=0;
+   glGetProgramiv(obj,GL_INFO_LOG_LENGTH,&len);
+   if (len>1)
+   {
+      char* buffer = (char*)malloc(len);
+      if (!buffer) Fatal("Cannot allocate %d bytes of text for program log\n",len);
+      glGetProgramInfoLog(obj,len,NULL,buffer);
+      fprintf(stderr,"%s\n",buffer);
+      free(buffer);
+   }
+   glGetProgramiv(obj,GL_LINK_STATUS,&len);
+   if (!len) Fatal("Error linking program\n");
+}
+
+//
+//  Turn "NAME NAME=VALUE ..." into #define lines
+//
+static char* Defines(const char* defines)
+{
+   int n = defines ? strlen(defines) : 0;
+   char* text = (char*)malloc(6*n+16);
+   if (!text) Fatal("Cannot allocate shader defines\n");
+   char* out = text;
+   *out = 0;
+   while (defines && *defines)
+   {
+      while (*defines==' ' || *defines==',') defines++;
+      if (!*defines) break;
+      out += sprintf(out,"#define ");
+      for (;*defines && *defines!=' ' && *defines!=',';defines++)
+         *out++ = *defines=='=' ? ' ' : *defines;
+      *out++ = '\n';
+      *out = 0;
+   }
+   return text;
+}
+
+//
+//  Compile shader file of type with the define lines
+//
+static int CompileShader(GLenum type,const char* file,const char* source,const char* defines)
+{
+   //  Defines go after the #version line, which only comments can precede
+   const char* body = source;
+   const char* version = strncmp(source,"#version",8) ? strstr(source,"\n#version") : source;
+   if (version)
+   {
+      body = strchr(version+1,'\n');
+      body = body ? body+1 : source+strlen(source);
+   }
+   const char* text[] = {source,defines,body};
+   int len[] = {body-source,-1,-1};
+   int shader = glCreateShader(type);
+   glShaderSource(shader,3,text,len);
+   fprintf(stderr,"Compile %s\n",file);
+   glCompileShader(shader);
+   ShaderLog(shader,file);
+   DebugLabel(GL_SHADER,shader,file);
+   return shader;
+}
+
+//
+//  64 bit FNV-1a hash of n bytes of data (n<0 for a string) continuing from h
+//
+static unsigned long long Hash(unsigned long long h,const void* data,int n)
+{
+   const unsigned char* p = (const unsigned char*)data;
+   if (n<0) n = strlen((const char*)data)+1;
+   for (int k=0;k<n;k++)
+      h = (h^p[k])*0x100000001b3ULL;
+   return h;
+}
+
+//
+//  Load program binary key from the cache into prog
+//    returns 0 if it is not there or the driver rejects it
+//
+static int CacheLoad(int prog,unsigned long long key,const char* file)
+{
+   FILE* f = fopen(file,"rb");
+   if (!f) return 0;
+   binhead_t h;
+   void* bin = NULL;
+   int ok = fread(&h,sizeof(h),1,f)==1 && h.magic==MAGIC && h.key==key && h.length>0 &&
+            (bin=malloc(h.length)) && fread(bin,h.length,1,f)==1;
+   fclose(f);
+   if (ok)
+   {
+      glProgramBinary(prog,h.format,bin,h.length);
+      glGetProgramiv(prog,GL_LINK_STATUS,&ok);
+   }
+   free(bin);
+   return ok;
+}
+
+//
+//  Save the binary of prog in the cache as key
+//
+static void CacheSave(int prog,unsigned long long key,const char* file)
+{
+   binhead_t h = {MAGIC,0,key,0};
+   glGetProgramiv(prog,GL_PROGRAM_BINARY_LENGTH,&h.length);
+   if (h.length<=0) return;
+   void* bin = malloc(h.length);
+   if (!bin) Fatal("Cannot allocate %d byte program binary\n",h.length);
+   glGetProgramBinary(prog,h.length,NULL,&h.format,bin);
+   //  Write a temporary file and rename it, so a reader never sees half a file
+   char tmp[320];
+   snprintf(tmp,sizeof(tmp),"%s.tmp",file);
+   mkdir(CACHE,0755);
+   FILE* f = fopen(tmp,"wb");
+   if (f)
+   {
+      int ok = fwrite(&h,sizeof(h),1,f)==1 && fwrite(bin,h.length,1,f)==1;
+      if (fclose(f) || !ok)
+         remove(tmp);
+      else
+      {
+         remove(file);
+         if (rename(tmp,file)) remove(tmp);
+      }
+   }
+   free(bin);
+}
+
+//
+//  Create a program from vertex and fragment shader files
+//    defines is a list of NAME or NAME=VALUE separated by spaces or
+//    commas (NULL for none)
+//
+int ShaderProgram(const char* vert,const char* frag,const char* defines)
+{
+   TraceBegin("ShaderProgram",vert);
+   double t0 = Timer();
+   if (cache<0)
+   {
+      int n=0;
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS,&n);
+      cache = n>0;
+   }
+   char* vs = ReadText(vert);
+   char* fs = ReadText(frag);
+   char* def = Defines(defines);
+   //  Key on the sources, the defines and the driver
+   unsigned long long key = 0xcbf29ce484222325ULL;
+   key = Hash(key,vs,-1);
+   key = Hash(key,fs,-1);
+   key = Hash(key,def,-1);
+   const char* gl[] = {(const char*)glGetString(GL_VENDOR),(const char*)glGetString(GL_RENDERER),(const char*)glGetString(GL_VERSION)};
+   for (int k=0;k<3;k++)
+      key = Hash(key,gl[k]?gl[k]:"",-1);
+   char file[256];
+   snprintf(file,sizeof(file),"%s/%016llx.bin",CACHE,key);
+
+   int prog = glCreateProgram();
+   if (cache && CacheLoad(prog,key,file))
+      Ncached++;
+   else
+   {
+      //  A rejected binary leaves the program unusable, so start over
+      glDeleteProgram(prog);
+      prog = glCreateProgram();
+      int vsh = CompileShader(GL_VERTEX_SHADER,vert,vs,def);
+      int fsh = CompileShader(GL_FRAGMENT_SHADER,frag,fs,def);
+      glAttachShader(prog,vsh);
+      glAttachShader(prog,fsh);
+      if (cache) glProgramParameteri(prog,GL_PROGRAM_BINARY_RETRIEVABLE_HINT,GL_TRUE);
+      glLinkProgram(prog);
+      ProgramLog(prog);
+      //  The program keeps what it needs from the shaders
+      glDetachShader(prog,vsh);
+      glDetachShader(prog,fsh);
+      glDeleteShader(vsh);
+      glDeleteShader(fsh);
+      if (cache) CacheSave(prog,key,file);
+   }
+   DebugLabel(GL_PROGRAM,prog,vert);
+   free(vs);
+   free(fs);
+   free(def);
+   Nprog++;
+   seconds += Timer()-t0;
+   TraceEnd();
+   return prog;
+}
+
+//
+//  Return the programs built, how many came from the cache and the
+//  seconds spent building them
+//
+void ShaderStats(int* nprog,int* ncached,double* sec)
+{
+   *nprog = Nprog;
+   *ncached = Ncached;
+   *sec = seconds;
+}
@@ -0,0 +1,242 @@
+//  CSCIx229 library
+//  Shadow map with a cached static layer
+#include "CSCIx229.h"
+
+//
+//  The shadow map is a perspective depth map from the light toward a
+//  target point.  Static casters are drawn into their own depth texture,
+//  which is kept until the light moves further than a threshold from
+//  where it was drawn (or ShadowInvalidate is called).  Every frame that
+//  depth is copied into the map used for lookups and only the dynamic
+//  casters are drawn over it.  Both layers use the light position of the
+//  cached layer, so they always line up; the shadows lag the light by at
+//  most the threshold.
+//
+//  The lighting shader reads the map through a shadow sampler on texture
+//  unit UNIT with ShadowMatrix, which takes eye coordinates to map
+//  coordinates.
+//
+
+#define UNIT 7  //  Texture unit of the shadow map
+
+static int prog=0;                 //  Lighting shader
+static int locMatrix,locShadows;   //  Its ShadowMatrix and Shadows uniforms
+static int size=0;                 //  Map width and height
+static unsigned int fbo[2];        //  Static and final framebuffers
+static unsigned int tex[2];        //  Static and final depth textures
+static float cached[3];            //  Light position of the static layer
+static int valid=0;                //  Static layer is current
+static float L[16];                //  Light projection times light view
+static int rebuilds=0;             //  Static layer redraws
+static unsigned int timer[2];      //  Timer queries
+static int timing[2]={0,0};        //  Timer query issued and not yet read
+static int frame=0;                //  ShadowFrame calls
+static double gpuTime=0;           //  Milliseconds of the last timed frame
+static double cpuTime=0;           //  Seconds in the last ShadowFrame
+
+//
+//  Create the shadow map
+//    prog is the lighting shader, size the map width and height
+//
+void ShadowInit(int shader,int n)
+{
+   prog = shader;
+   size = n;
+   glGenFramebuffers(2,fbo);
+   glGenTextures(2,tex);
+   for (int k=0;k<2;k++)
+   {
+      float border[] = {1,1,1,1};
+      glBindTexture(GL_TEXTURE_2D,tex[k]);
+      glTexImage2D(GL_TEXTURE_2D,0,GL_DEPTH_COMPONENT24,size,size,0,GL_DEPTH_COMPONENT,GL_UNSIGNED_INT,NULL);
+      //  Linear filtering of a compared map gives 2x2 percentage closer filtering
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+      //  Outside the map is lit
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_BORDER);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_BORDER);
+      glTexParameterfv(GL_TEXTURE_2D,GL_TEXTURE_BORDER_COLOR,border);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_COMPARE_MODE,GL_COMPARE_R_TO_TEXTURE);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_COMPARE_FUNC,GL_LEQUAL);
+      glBindFramebuffer(GL_FRAMEBUFFER,fbo[k]);
+      glFramebufferTexture2D(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,GL_TEXTURE_2D,tex[k],0);
+      glDrawBuffer(GL_NONE);
+      glReadBuffer(GL_NONE);
+      if (glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE) Fatal("Shadow framebuffer incomplete\n");
+   }
+   glBindFramebuffer(GL_FRAMEBUFFER,0);
+   glBindTexture(GL_TEXTURE_2D,0);
+   locMatrix  = glGetUniformLocation(prog,"ShadowMatrix");
+   locShadows = glGetUniformLocation(prog,"Shadows");
+   glUseProgram(prog);
+   glUniform1i(glGetUniformLocation(prog,"Shadow"),UNIT);
+   glUniform1i(locShadows,0);
+   glUseProgram(0);
+}
+
+//
+//  Draw the static casters again next frame
+//
+void ShadowInvalidate(void)
+{
+   valid = 0;
+}
+
+//
+//  Draw casters into framebuffer f from the light
+//
+static void ShadowDraw(int f,int clear,scenedraw_t draw)
+{
+   glBindFramebuffer(GL_FRAMEBUFFER,fbo[f]);
+   if (clear) glClear(GL_DEPTH_BUFFER_BIT);
+   glMatrixMode(GL_PROJECTION);
+   glPushMatrix();
+   glLoadMatrixf(L);
+   glMatrixMode(GL_MODELVIEW);
+   glPushMatrix();
+   glLoadIdentity();
+   draw(0);
+   glPopMatrix();
+   glMatrixMode(GL_PROJECTION);
+   glPopMatrix();
+   glMatrixMode(GL_MODELVIEW);
+}
+
+//
+//  Time the shadow passes with alternating timer queries
+//
+static void ShadowTimer(int start)
+{
+   int k = frame%2;
+   if (start)
+   {
+      if (!timer[0]) glGenQueries(2,timer);
+      if (timing[k])
+      {
+         int ready;
+         glGetQueryObjectiv(timer[k],GL_QUERY_RESULT_AVAILABLE,&ready);
+         if (!ready) return;
+         GLuint64 ns;
+         glGetQueryObjectui64v(timer[k],GL_QUERY_RESULT,&ns);
+         gpuTime = 1e-6*ns;
+      }
+      glBeginQuery(GL_TIME_ELAPSED,timer[k]);
+      timing[k] = 2;
+   }
+   else if (timing[k]==2)
+   {
+      glEndQuery(GL_TIME_ELAPSED);
+      timing[k] = 1;
+   }
+}
+
+//
+//  Update the shadow map for a light at position looking at target
+//    fov, znear and zfar set the light's frustum
+//    threshold is how far the light may move before the static layer
+//    is drawn again
+//    statics and dynamics draw the casters in world coordinates
+//    call with the view matrix as the modelview
+//
+void ShadowFrame(const float position[3],const float target[3],float fov,float znear,float zfar,
+                 float threshold,scenedraw_t statics,scenedraw_t dynamics)
+{
+   double t0 = Timer();
+   float dx = position[0]-cached[0];
+   float dy = position[1]-cached[1];
+   float dz = position[2]-cached[2];
+   int rebuild = !valid || dx*dx+dy*dy+dz*dz>threshold*threshold;
+   ShadowTimer(1);
+   glPushAttrib(GL_ENABLE_BIT|GL_COLOR_BUFFER_BIT|GL_VIEWPORT_BIT|GL_POLYGON_BIT|GL_LIGHTING_BIT|GL_TEXTURE_BIT|GL_CURRENT_BIT);
+   int cur;
+   glGetIntegerv(GL_CURRENT_PROGRAM,&cur);
+   glUseProgram(0);
+   glViewport(0,0,size,size);
+   glColorMask(0,0,0,0);
+   glEnable(GL_DEPTH_TEST);
+   glDisable(GL_LIGHTING);
+   glDisable(GL_TEXTURE_2D);
+   glEnable(GL_POLYGON_OFFSET_FILL);
+   glPolygonOffset(2,4);
+   if (rebuild)
+   {
+      memcpy(cached,position,sizeof(cached));
+      //  Light projection times light view, made with the matrix stack
+      glMatrixMode(GL_PROJECTION);
+      glPushMatrix();
+      glLoadIdentity();
+      gluPerspective(fov,1,znear,zfar);
+      gluLookAt(position[0],position[1],position[2],target[0],target[1],target[2],0,1,0);
+      glGetFloatv(GL_PROJECTION_MATRIX,L);
+      glPopMatrix();
+      glMatrixMode(GL_MODELVIEW);
+      ShadowDraw(0,1,statics);
+      valid = 1;
+      rebuilds++;
+   }
+   //  Start from the static layer and add the dynamic casters
+   glBindFramebuffer(GL_READ_FRAMEBUFFER,fbo[0]);
+   glBindFramebuffer(GL_DRAW_FRAMEBUFFER,fbo[1]);
+   glBlitFramebuffer(0,0,size,size,0,0,size,size,GL_DEPTH_BUFFER_BIT,GL_NEAREST);
+   ShadowDraw(1,0,dynamics);
+   glBindFramebuffer(GL_FRAMEBUFFER,0);
+   glPopAttrib();
+   ShadowTimer(0);
+   frame++;
+
+   //  Eye coordinates to map coordinates: bias * L * inverse(view)
+   float V[16],I[16],S[16];
+   glGetFloatv(GL_MODELVIEW_MATRIX,V);
+   //  The view is a rotation and translation, so its inverse is the transpose
+   for (int i=0;i<3;i++)
+   {
+      for (int j=0;j<3;j++)
+         I[4*j+i] = V[4*i+j];
+      I[12+i] = -(V[4*i]*V[12] + V[4*i+1]*V[13] + V[4*i+2]*V[14]);
+      I[4*i+3] = 0;
+   }
+   I[15] = 1;
+   for (int i=0;i<4;i++)
+      for (int j=0;j<4;j++)
+      {
+         float s = 0;
+         for (int k=0;k<4;k++)
+            s += L[4*k+i]*I[4*j+k];
+         S[4*j+i] = s;
+      }
+   //  Map -1..1 to 0..1
+   for (int j=0;j<4;j++)
+      for (int i=0;i<3;i++)
+         S[4*j+i] = 0.5*(S[4*j+i]+S[4*j+3]);
+   glActiveTexture(GL_TEXTURE0+UNIT);
+   glBindTexture(GL_TEXTURE_2D,tex[1]);
+   glActiveTexture(GL_TEXTURE0);
+   glUseProgram(prog);
+   glUniformMatrix4fv(locMatrix,1,0,S);
+   glUniform1i(locShadows,1);
+   glUseProgram(cur);
+   cpuTime = Timer()-t0;
+}
+
+//
+//  Stop shadowing until the next ShadowFrame
+//
+void ShadowOff(void)
+{
+   int cur;
+   glGetIntegerv(GL_CURRENT_PROGRAM,&cur);
+   glUseProgram(prog);
+   glUniform1i(locShadows,0);
+   glUseProgram(cur);
+}
+
+//
+//  Return the static layer redraws so far, the CPU seconds of the last
+//  ShadowFrame and the GPU milliseconds of an earlier one
+//
+void ShadowStats(int* nrebuild,double* cpu,double* gpu)
+{
+   *nrebuild = rebuilds;
+   *cpu      = cpuTime;
+   *gpu      = gpuTime;
+}
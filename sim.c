@@ -0,0 +1,255 @@
+//  CSCIx229 library
+//  Fixed timestep simulation thread with interpolated snapshots
+#include "CSCIx229.h"
+#include <stdatomic.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+//
+//  The simulation is a state of a fixed size that a step function
+//  advances by a fixed dt.  SimStart runs the steps on their own thread
+//  in real time, so the motion no longer depends on how fast frames are
+//  drawn, and SimRun runs them on the caller up to a given time, which
+//  is how a benchmark on a simulated clock stays repeatable.
+//
+//  Each step is published as a snapshot into a ring of NSLOT, and the
+//  renderer copies the newest two with SimRead and blends them by how
+//  far the frame is past the newest, so it shows the simulation one
+//  step behind but moving smoothly at any frame rate.  The ring has a
+//  single writer, which publishes a snapshot by advancing the step count
+//  with a release store.  The reader copies without a lock and checks
+//  the count again afterwards: if the writer came around to the slots it
+//  was copying it copies again.
+//
+//  Steps a thread falls behind by more than MAXLAG seconds, say while
+//  the process was stopped, are dropped rather than run all at once.
+//
+//  SimActive(0) parks the thread on a condition variable until
+//  SimActive(1), for when nothing the steps do is being shown.  The
+//  clock then carries on from the newest step, so the time parked is
+//  neither stepped through nor blended across.
+//
+
+#define NSLOT  4     //  Snapshots in the ring
+#define MAXLAG 0.25  //  Seconds of steps run to catch up
+
+static simstep_t step=NULL;       //  Step function
+static int size=0;                //  Bytes of state
+static double dt=0;               //  Seconds per step
+static unsigned char* work=NULL;  //  State the steps run on
+static unsigned char* slot[NSLOT];//  Published snapshots
+static atomic_ulong Nstep;        //  Steps published
+static _Atomic double start=0;    //  Timer() at step 0 when threaded
+static int threaded=0;            //  Steps run on the simulation thread
+static double runTo=0;            //  Time SimRun has reached
+static int active=1;              //  Thread steps rather than parks
+#ifdef _WIN32
+static SRWLOCK lock=SRWLOCK_INIT;
+static CONDITION_VARIABLE wake=CONDITION_VARIABLE_INIT;
+#else
+static pthread_mutex_t lock=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake=PTHREAD_COND_INITIALIZER;
+#endif
+//  Step timing, written by the stepping thread and read as a whole
+static atomic_ulong stepCount;
+static _Atomic double stepTotal,stepMax;
+
+//
+//  Set up a simulation of size bytes that step advances at hz steps a
+//    second from state
+//
+void SimInit(simstep_t fn,const void* state,int bytes,double hz)
+{
+   step = fn;
+   size = bytes;
+   dt = 1/hz;
+   work = (unsigned char*)malloc(size);
+   if (!work) Fatal("Cannot allocate %d bytes of simulation state\n",size);
+   memcpy(work,state,size);
+   for (int k=0;k<NSLOT;k++)
+   {
+      slot[k] = (unsigned char*)malloc(size);
+      if (!slot[k]) Fatal("Cannot allocate %d bytes of simulation state\n",size);
+      memcpy(slot[k],state,size);
+   }
+   atomic_init(&Nstep,0);
+   atomic_init(&stepCount,0);
+   atomic_init(&stepTotal,0);
+   atomic_init(&stepMax,0);
+}
+
+//
+//  Run one step and publish it
+//
+static void SimStep(void)
+{
+   TraceBegin("step",NULL);
+   double t0 = Timer();
+   step(work,dt);
+   unsigned long n = atomic_load_explicit(&Nstep,memory_order_relaxed)+1;
+   memcpy(slot[n%NSLOT],work,size);
+   atomic_store_explicit(&Nstep,n,memory_order_release);
+   double t = Timer()-t0;
+   atomic_store_explicit(&stepTotal,atomic_load_explicit(&stepTotal,memory_order_relaxed)+t,memory_order_relaxed);
+   if (t>atomic_load_explicit(&stepMax,memory_order_relaxed)) atomic_store_explicit(&stepMax,t,memory_order_relaxed);
+   atomic_fetch_add_explicit(&stepCount,1,memory_order_relaxed);
+   TraceEnd();
+}
+
+//
+//  Sleep until Timer() reaches t
+//
+static void SimSleep(double t)
+{
+   double s = t-Timer();
+   if (s<=0) return;
+#ifdef _WIN32
+   Sleep((DWORD)(1000*s));
+#else
+   struct timespec ts;
+   ts.tv_sec = (time_t)s;
+   ts.tv_nsec = (long)(1e9*(s-ts.tv_sec));
+   nanosleep(&ts,NULL);
+#endif
+}
+
+//
+//  Wait while the simulation is parked
+//
+static void SimPark(void)
+{
+#ifdef _WIN32
+   AcquireSRWLockExclusive(&lock);
+#else
+   pthread_mutex_lock(&lock);
+#endif
+   if (!active)
+   {
+      TraceBegin("parked",NULL);
+      while (!active)
+#ifdef _WIN32
+         SleepConditionVariableSRW(&wake,&lock,INFINITE,0);
+#else
+         pthread_cond_wait(&wake,&lock);
+#endif
+      TraceEnd();
+      //  Due now, with the newest step fully blended in until it runs
+      unsigned long n = atomic_load_explicit(&Nstep,memory_order_relaxed);
+      atomic_store(&start,Timer()-(n+1)*dt);
+   }
+#ifdef _WIN32
+   ReleaseSRWLockExclusive(&lock);
+#else
+   pthread_mutex_unlock(&lock);
+#endif
+}
+
+//
+//  Simulation thread: step at a fixed rate on the wall clock
+//
+#ifdef _WIN32
+static DWORD WINAPI SimThread(void* arg)
+#else
+static void* SimThread(void* arg)
+#endif
+{
+   TraceThread("sim");
+   for (;;)
+   {
+      SimPark();
+      unsigned long n = atomic_load_explicit(&Nstep,memory_order_relaxed)+1;
+      double due = start+n*dt;
+      SimSleep(due);
+      //  Drop the steps of a long stall
+      double lag = Timer()-due;
+      if (lag > MAXLAG)
+      {
+         unsigned long skip = (unsigned long)(lag/dt);
+         atomic_store(&start,start+skip*dt);
+      }
+      SimStep();
+   }
+   return 0;
+}
+
+//
+//  Step the simulation in real time on its own thread
+//
+void SimStart(void)
+{
+   start = Timer();
+   threaded = 1;
+#ifdef _WIN32
+   if (!CreateThread(NULL,0,SimThread,NULL,0,NULL)) Fatal("Cannot start the simulation thread\n");
+#else
+   pthread_t id;
+   if (pthread_create(&id,NULL,SimThread,NULL)) Fatal("Cannot start the simulation thread\n");
+   pthread_detach(id);
+#endif
+}
+
+//
+//  Park the simulation thread (0) or run it again (1)
+//
+void SimActive(int on)
+{
+#ifdef _WIN32
+   AcquireSRWLockExclusive(&lock);
+   active = on;
+   ReleaseSRWLockExclusive(&lock);
+   if (on) WakeConditionVariable(&wake);
+#else
+   pthread_mutex_lock(&lock);
+   active = on;
+   pthread_mutex_unlock(&lock);
+   if (on) pthread_cond_signal(&wake);
+#endif
+}
+
+//
+//  Step the simulation on this thread until t seconds from the start
+//
+void SimRun(double t)
+{
+   if (threaded) return;
+   runTo = t;
+   while ((atomic_load_explicit(&Nstep,memory_order_relaxed)+1)*dt <= t)
+      SimStep();
+}
+
+//
+//  Copy the newest snapshot to cur and the one before to prev
+//    returns how far to blend from prev to cur (0 to 1) for now
+//
+double SimRead(void* prev,void* cur)
+{
+   unsigned long n,m;
+   do
+   {
+      n = atomic_load_explicit(&Nstep,memory_order_acquire);
+      memcpy(cur,slot[n%NSLOT],size);
+      memcpy(prev,slot[(n?n-1:0)%NSLOT],size);
+      atomic_thread_fence(memory_order_acquire);
+      m = atomic_load_explicit(&Nstep,memory_order_relaxed);
+      //  The slot after m is being written
+   } while (m-n >= NSLOT-2);
+   double now = threaded ? Timer()-start : runTo;
+   double alpha = (now-n*dt)/dt;
+   return alpha<0 ? 0 : alpha>1 ? 1 : alpha;
+}
+
+//
+//  Return the steps run, the mean and longest step in seconds and the
+//  step rate
+//
+void SimStats(int* nstep,double* mean,double* max,double* hz)
+{
+   unsigned long n = atomic_load_explicit(&stepCount,memory_order_relaxed);
+   *nstep = n;
+   *mean = n ? atomic_load_explicit(&stepTotal,memory_order_relaxed)/n : 0;
+   *max = atomic_load_explicit(&stepMax,memory_order_relaxed);
+   *hz = dt>0 ? 1/dt : 0;
+}
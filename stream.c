@@ -0,0 +1,136 @@
+//  CSCIx229 library
+//  Persistently mapped ring buffer for per frame data
+#include "CSCIx229.h"
+
+//
+//  One buffer object is split into FRAMES regions, one for each frame
+//  the GPU may still be working on.  A frame copies its uniform blocks,
+//  instance data and texture uploads into its region with StreamWrite
+//  and draws from the returned offsets.  StreamEnd puts a fence after
+//  the frame's commands and moves to the next region; StreamBegin waits
+//  on that region's fence from FRAMES frames ago, which is the only
+//  place the CPU can stall, and the time spent there is counted.
+//
+//  With GL_ARB_buffer_storage the buffer is mapped once, persistent and
+//  coherent, so a write is a memcpy.  Without it each write becomes a
+//  glBufferSubData into the same region, still guarded by the fences.
+//
+
+#define FRAMES 3  //  Frames in flight
+
+static unsigned int buf=0;       //  Ring buffer
+static char* map=NULL;           //  Persistent mapping (NULL without buffer storage)
+static int size=0;               //  Bytes in each region
+static int align=16;             //  Offset alignment of writes
+static int region=0;             //  Region of the current frame
+static int used=0;               //  Bytes written to the current region
+static GLsync fence[FRAMES];     //  End of the last frame in each region
+static int lastUsed=0;           //  Bytes written in the last frame
+static int stalls=0;             //  Frames that waited for a region
+static double stallTime=0;       //  Seconds waited in the last StreamBegin
+
+//
+//  Create the ring with n bytes for each frame
+//
+void StreamInit(int n)
+{
+   int a;
+   glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT,&a);
+   if (a>align) align = a;
+   size = (n+align-1)/align*align;
+   glGenBuffers(1,&buf);
+   glBindBuffer(GL_ARRAY_BUFFER,buf);
+   DebugLabel(GL_BUFFER,buf,"stream");
+#ifdef GL_ARB_buffer_storage
+   const char* ext = (const char*)glGetString(GL_EXTENSIONS);
+   if (ext && strstr(ext,"GL_ARB_buffer_storage"))
+   {
+      GLbitfield flags = GL_MAP_WRITE_BIT|GL_MAP_PERSISTENT_BIT|GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_ARRAY_BUFFER,FRAMES*size,NULL,flags);
+      map = (char*)glMapBufferRange(GL_ARRAY_BUFFER,0,FRAMES*size,flags);
+      if (!map) Fatal("Cannot map the %d byte stream buffer\n",FRAMES*size);
+   }
+   else
+#endif
+      glBufferData(GL_ARRAY_BUFFER,FRAMES*size,NULL,GL_STREAM_DRAW);
+   glBindBuffer(GL_ARRAY_BUFFER,0);
+   memset(fence,0,sizeof(fence));
+   region = used = 0;
+}
+
+//
+//  Start a frame
+//    waits until the GPU is done with the frame that last used the region
+//
+void StreamBegin(void)
+{
+   stallTime = 0;
+   if (!fence[region]) return;
+   //  Poll first, then wait with a flush so the fence is sure to be signalled
+   GLenum r = glClientWaitSync(fence[region],0,0);
+   if (r==GL_TIMEOUT_EXPIRED)
+   {
+      double t0 = Timer();
+      do
+         r = glClientWaitSync(fence[region],GL_SYNC_FLUSH_COMMANDS_BIT,1000000);
+      while (r==GL_TIMEOUT_EXPIRED);
+      stallTime = Timer()-t0;
+      stalls++;
+   }
+   if (r==GL_WAIT_FAILED) Fatal("Stream fence wait failed\n");
+   glDeleteSync(fence[region]);
+   fence[region] = 0;
+}
+
+//
+//  Copy n bytes into the current region and return their offset in the
+//  buffer, a multiple of the uniform buffer offset alignment
+//
+int StreamWrite(const void* data,int n)
+{
+   if (!buf) Fatal("StreamWrite called before StreamInit\n");
+   if (used+n>size) Fatal("Stream region of %d bytes is full\n",size);
+   int off = region*size + used;
+   if (map)
+      memcpy(map+off,data,n);
+   else
+   {
+      glBindBuffer(GL_ARRAY_BUFFER,buf);
+      glBufferSubData(GL_ARRAY_BUFFER,off,n,data);
+      glBindBuffer(GL_ARRAY_BUFFER,0);
+   }
+   used += (n+align-1)/align*align;
+   return off;
+}
+
+//
+//  Return the ring buffer
+//
+unsigned int StreamBuffer(void)
+{
+   return buf;
+}
+
+//
+//  End a frame
+//    fences the region after this frame's commands and moves to the next
+//
+void StreamEnd(void)
+{
+   if (!buf) return;
+   fence[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+   region = (region+1)%FRAMES;
+   lastUsed = used;
+   used = 0;
+}
+
+//
+//  Return the bytes written in the last frame, the frames that stalled
+//  so far and the seconds the last StreamBegin waited
+//
+void StreamStats(int* nbytes,int* nstall,double* stall)
+{
+   *nbytes = lastUsed;
+   *nstall = stalls;
+   *stall  = stallTime;
+}
@@ -0,0 +1,85 @@
+/*
+ *  Text rendering benchmark
+ *  Times 10k glyphs a frame drawn one glutBitmapCharacter at a time and
+ *  batched from the font atlas, and checks both draw the same pixels
+ *
+ *  make textbench && ./textbench
+ */
+#include "CSCIx229.h"
+
+#define WIDTH  800
+#define HEIGHT 600
+#define LINES  100   //  Lines a frame
+#define CHARS  100   //  Characters a line
+#define FRAMES 50    //  Frames timed
+
+static char line[CHARS+1];
+
+/*
+ *  Draw and finish one frame of n lines
+ *    returns the seconds spent issuing the text
+ */
+static double Frame(int n){
+   StreamBegin();
+   glClear(GL_COLOR_BUFFER_BIT);
+   glFinish();
+   double t = Timer();
+   for (int k = 0; k < n; k++){
+      glColor3f(k%3==0, k%3==1, 1);
+      glWindowPos2i(5+k%7, 5+(k*20)%(HEIGHT-30));
+      Print("%s", line);
+   }
+   PrintFlush();
+   t = Timer()-t;
+   StreamEnd();
+   glFinish();
+   return t;
+}
+
+/*
+ *  Milliseconds a frame of LINES lines takes to issue and to finish
+ */
+static void Time(const char* name, double* frame){
+   for (int k = 0; k < 5; k++)
+      Frame(LINES);
+   double t = Timer(), issue = 0;
+   for (int k = 0; k < FRAMES; k++)
+      issue += Frame(LINES);
+   double ms = 1000*(Timer()-t)/FRAMES;
+   printf("%-20s issue %8.3f ms  frame %8.3f ms", name, 1000*issue/FRAMES, ms);
+   if (*frame > 0) printf("  %5.1fx", *frame/ms);
+   printf("\n");
+   *frame = ms;
+}
+
+int main(int argc, char* argv[]){
+   glutInit(&argc, argv);
+   glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE);
+   glutInitWindowSize(WIDTH, HEIGHT);
+   glutCreateWindow("textbench");
+   glViewport(0, 0, WIDTH, HEIGHT);
+   StreamInit(4<<20);
+   for (int k = 0; k < CHARS; k++)
+      line[k] = '!'+k%94;
+   unsigned char* before = (unsigned char*)malloc(4*WIDTH*HEIGHT);
+   unsigned char* after = (unsigned char*)malloc(4*WIDTH*HEIGHT);
+   if (!before || !after) Fatal("Cannot allocate benchmark images\n");
+
+   printf("%d glyphs a frame on %s\n", LINES*CHARS, glGetString(GL_RENDERER));
+   double frame = 0;
+   //  One character at a time
+   Frame(3);
+   glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, before);
+   Time("glutBitmapCharacter", &frame);
+   //  Font atlas
+   PrintInit();
+   Frame(3);
+   glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, after);
+   Time("font atlas", &frame);
+
+   int diff = 0;
+   for (int k = 0; k < 4*WIDTH*HEIGHT; k += 4)
+      diff += memcmp(before+k, after+k, 3) != 0;
+   printf("%d pixels differ\n", diff);
+   return 0;
+}
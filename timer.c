@@ -0,0 +1,24 @@
+//  CSCIx229 library
+//  High resolution timer
+#include "CSCIx229.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+//
+//  Seconds from an arbitrary fixed point on a monotonic clock
+//
+double Timer(void)
+{
+#ifdef _WIN32
+   static LARGE_INTEGER freq;
+   LARGE_INTEGER now;
+   if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+   QueryPerformanceCounter(&now);
+   return (double)now.QuadPart/freq.QuadPart;
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC,&ts);
+   return ts.tv_sec + 1e-9*ts.tv_nsec;
+#endif
+}
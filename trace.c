@@ -0,0 +1,197 @@
+//  CSCIx229 library
+//  Timeline recording in Chrome trace event format
+#include "CSCIx229.h"
+#include <stdatomic.h>
+
+//
+//  TraceBegin and TraceEnd bracket a named span on the calling thread.
+//  Spans are written as complete ("X") events into a ring owned by the
+//  thread, so recording takes no lock: each ring has a single writer,
+//  which publishes an event by advancing the ring head with a release
+//  store.  A ring holds the last RINGSIZE spans of its thread.
+//
+//  TraceDump copies every ring and writes the spans as Chrome trace
+//  event JSON, which chrome://tracing and Perfetto open.  It can run
+//  while other threads keep recording: spans overwritten during the
+//  copy are left out.
+//
+//  Until TraceStart turns recording on, TraceBegin and TraceEnd return
+//  after testing one flag.  Recording is never turned off again, so a
+//  span open when it starts simply ends without being recorded.
+//
+
+#define MAXTHREAD 16            //  Threads that can record
+#define RINGSIZE  (1<<16)       //  Spans kept per thread (a power of two)
+#define MAXOPEN   64            //  Deepest nesting on one thread
+
+typedef struct
+{
+   const char* name;  //  Span name
+   const char* arg;   //  Detail shown with the span (may be NULL)
+   double ts,dur;     //  Start and duration in seconds
+} span_t;
+
+typedef struct
+{
+   span_t span[RINGSIZE];       //  Recorded spans
+   atomic_ulong head;           //  Spans written so far
+   const char* name;            //  Thread name
+   int depth;                   //  Open spans
+   const char* open[MAXOPEN];   //  Names of the open spans
+   const char* openArg[MAXOPEN];
+   double start[MAXOPEN];       //  Start times of the open spans
+} ring_t;
+
+static volatile int on=0;                       //  Recording
+static _Atomic(ring_t*) ring[MAXTHREAD];        //  Rings of the recording threads
+static atomic_int Nring;                        //  Rings handed out
+static _Thread_local ring_t* mine=NULL;         //  Ring of this thread
+static _Thread_local const char* myName=NULL;   //  Name of this thread
+
+//
+//  Ring of the calling thread, created on first use
+//
+static ring_t* TraceRing(void)
+{
+   if (mine) return mine;
+   int k = atomic_fetch_add(&Nring,1);
+   if (k>=MAXTHREAD) Fatal("More than %d threads are tracing\n",MAXTHREAD);
+   ring_t* r = (ring_t*)calloc(1,sizeof(ring_t));
+   if (!r) Fatal("Cannot allocate trace ring\n");
+   atomic_init(&r->head,0);
+   r->name = myName;
+   atomic_store_explicit(&ring[k],r,memory_order_release);
+   return mine = r;
+}
+
+//
+//  Start recording
+//
+void TraceStart(void)
+{
+   on = 1;
+}
+
+//
+//  Return whether recording is on
+//
+int TraceOn(void)
+{
+   return on;
+}
+
+//
+//  Name the calling thread in the trace
+//    name must stay valid until the last TraceDump
+//
+void TraceThread(const char* name)
+{
+   myName = name;
+   if (mine) mine->name = name;
+}
+
+//
+//  Open the span called name on this thread
+//    arg is a detail such as a file name and may be NULL
+//    both must stay valid until the last TraceDump
+//
+void TraceBegin(const char* name,const char* arg)
+{
+   if (!on) return;
+   ring_t* r = TraceRing();
+   if (r->depth>=MAXOPEN) Fatal("Trace spans nested deeper than %d\n",MAXOPEN);
+   r->open[r->depth] = name;
+   r->openArg[r->depth] = arg;
+   r->start[r->depth++] = Timer();
+}
+
+//
+//  Close the innermost span on this thread
+//
+void TraceEnd(void)
+{
+   if (!on || !mine || !mine->depth) return;
+   ring_t* r = mine;
+   double t = Timer();
+   r->depth--;
+   unsigned long h = atomic_load_explicit(&r->head,memory_order_relaxed);
+   span_t* s = r->span + (h&(RINGSIZE-1));
+   s->name = r->open[r->depth];
+   s->arg  = r->openArg[r->depth];
+   s->ts   = r->start[r->depth];
+   s->dur  = t-s->ts;
+   atomic_store_explicit(&r->head,h+1,memory_order_release);
+}
+
+//
+//  Write a JSON string
+//
+static void TraceString(FILE* f,const char* s)
+{
+   fputc('"',f);
+   for (;*s;s++)
+   {
+      if (*s=='"' || *s=='\\')
+         fprintf(f,"\\%c",*s);
+      else if ((unsigned char)*s<32)
+         fprintf(f,"\\u%04x",*s);
+      else
+         fputc(*s,f);
+   }
+   fputc('"',f);
+}
+
+//
+//  Write the recorded spans of all threads to file as Chrome trace
+//  event JSON and return the number of spans written
+//
+int TraceDump(const char* file)
+{
+   FILE* f = fopen(file,"w");
+   if (!f) Fatal("Cannot open trace file %s\n",file);
+   span_t* copy = (span_t*)malloc(RINGSIZE*sizeof(span_t));
+   if (!copy) Fatal("Cannot allocate trace copy\n");
+   fprintf(f,"{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+   int n=0,first=1;
+   int nring = atomic_load_explicit(&Nring,memory_order_acquire);
+   if (nring>MAXTHREAD) nring = MAXTHREAD;
+   for (int k=0;k<nring;k++)
+   {
+      ring_t* r = atomic_load_explicit(&ring[k],memory_order_acquire);
+      if (!r) continue;
+      //  Copy the spans, then drop those the writer may have reused since
+      unsigned long h0 = atomic_load_explicit(&r->head,memory_order_acquire);
+      unsigned long lo = h0>RINGSIZE ? h0-RINGSIZE : 0;
+      for (unsigned long i=lo;i<h0;i++)
+         copy[i&(RINGSIZE-1)] = r->span[i&(RINGSIZE-1)];
+      unsigned long h1 = atomic_load_explicit(&r->head,memory_order_acquire);
+      if (h1>=RINGSIZE && h1-RINGSIZE+1>lo) lo = h1-RINGSIZE+1;
+      if (r->name)
+      {
+         fprintf(f,"%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": ",first?"":",\n",k);
+         TraceString(f,r->name);
+         fprintf(f,"}}");
+         first = 0;
+      }
+      for (unsigned long i=lo;i<h0;i++)
+      {
+         span_t* s = copy+(i&(RINGSIZE-1));
+         fprintf(f,"%s{\"name\": ",first?"":",\n");
+         TraceString(f,s->name);
+         fprintf(f,", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",k,1e6*s->ts,1e6*s->dur);
+         if (s->arg)
+         {
+            fprintf(f,", \"args\": {\"arg\": ");
+            TraceString(f,s->arg);
+            fprintf(f,"}");
+         }
+         fprintf(f,"}");
+         first = 0;
+         n++;
+      }
+   }
+   fprintf(f,"\n]}\n");
+   fclose(f);
+   free(copy);
+   return n;
+}
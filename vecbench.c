@@ -0,0 +1,208 @@
+/*
+ *  Vector math microbenchmark
+ *  Times the float vecmath.c routines against the double precision
+ *  helpers and degree macros they replaced in final.c, and world matrix
+ *  updates of the xform.c hierarchy against the OpenGL matrix stack
+ *
+ *  make vecbench && ./vecbench
+ */
+#include "CSCIx229.h"
+
+#define N 1000000  //  Vectors per pass
+#define PASSES 20
+#define CHAINS 100     //  Transform chains
+#define DEPTH  1000    //  Nodes a chain
+
+/*
+ *  The replaced helpers, as they were in final.c
+ */
+static void CrossProduct(double vect_A[], double vect_B[], double cross_P[]){
+   cross_P[0] = vect_A[1] * vect_B[2] - vect_A[2] * vect_B[1];
+   cross_P[1] = vect_A[2] * vect_B[0] - vect_A[0] * vect_B[2];
+   cross_P[2] = vect_A[0] * vect_B[1] - vect_A[1] * vect_B[0];
+}
+static void Normalize(double vect_A[]){
+   double norm = sqrt(vect_A[0]*vect_A[0] + vect_A[1] * vect_A[1] + vect_A[2] * vect_A[2]);
+   vect_A[0] /= norm;
+   vect_A[1] /= norm;
+   vect_A[2] /= norm;
+}
+
+/*
+ *  Report a timing as millions of operations per second
+ */
+static void Report(const char* name, double seconds, double* baseline){
+   double rate = 1e-6*N*PASSES/seconds;
+   if (baseline && *baseline > 0)
+      printf("%-34s %8.1f M/s  %5.2fx\n", name, rate, rate/(*baseline));
+   else
+      printf("%-34s %8.1f M/s\n", name, rate);
+   if (baseline && *baseline == 0) *baseline = rate;
+}
+
+int main(){
+   double* da = (double*)malloc(3*N*sizeof(double));
+   double* db = (double*)malloc(3*N*sizeof(double));
+   double* dc = (double*)malloc(3*N*sizeof(double));
+   float* fa = (float*)malloc(3*N*sizeof(float));
+   float* fb = (float*)malloc(3*N*sizeof(float));
+   float* fc = (float*)malloc(3*N*sizeof(float));
+   if (!da || !db || !dc || !fa || !fb || !fc) Fatal("Cannot allocate benchmark vectors\n");
+   srand(1);
+   for (int k = 0; k < 3*N; k++){
+      fa[k] = da[k] = rand()/(double)RAND_MAX-0.5;
+      fb[k] = db[k] = rand()/(double)RAND_MAX-0.5;
+   }
+   double t, sum = 0, base;
+
+   //  Normalize
+   base = 0;
+   t = Timer();
+   for (int p = 0; p < PASSES; p++){
+      memcpy(dc, da, 3*N*sizeof(double));
+      dc[0] += p;
+      for (int k = 0; k < N; k++)
+         Normalize(dc+3*k);
+      sum += dc[0];
+   }
+   Report("Normalize (double)", Timer()-t, &base);
+   t = Timer();
+   for (int p = 0; p < PASSES; p++){
+      memcpy(fc, fa, 3*N*sizeof(float));
+      fc[0] += p;
+      for (int k = 0; k < N; k++)
+         Vec3Normalize(fc+3*k);
+      sum += fc[0];
+   }
+   Report("Vec3Normalize", Timer()-t, &base);
+   t = Timer();
+   for (int p = 0; p < PASSES; p++){
+      memcpy(fc, fa, 3*N*sizeof(float));
+      fc[0] += p;
+      Vec3NormalizeArray(fc, N);
+      sum += fc[0];
+   }
+   Report("Vec3NormalizeArray", Timer()-t, &base);
+
+   //  Cross product
+   base = 0;
+   t = Timer();
+   for (int p = 0; p < PASSES; p++){
+      for (int k = 0; k < N; k++)
+         CrossProduct(da+3*k, db+3*k, dc+3*k);
+      sum += dc[p];
+   }
+   Report("CrossProduct (double)", Timer()-t, &base);
+   t = Timer();
+   for (int p = 0; p < PASSES; p++){
+      for (int k = 0; k < N; k++)
+         Vec3Cross(fc+3*k, fa+3*k, fb+3*k);
+      sum += fc[p];
+   }
+   Report("Vec3Cross", Timer()-t, &base);
+   t = Timer();
+   for (int p = 0; p < PASSES; p++){
+      Vec3CrossArray(fc, fa, fb, N);
+      sum += fc[p];
+   }
+   Report("Vec3CrossArray", Timer()-t, &base);
+
+   //  Sine and cosine of whole degrees
+   base = 0;
+   t = Timer();
+   for (int p = 0; p < PASSES; p++)
+      for (int k = 0; k < N; k++){
+         int th = (k*7+p)%720-360;
+         sum += Sin(th)+Cos(th);
+      }
+   Report("Sin/Cos macros", Timer()-t, &base);
+   t = Timer();
+   for (int p = 0; p < PASSES; p++)
+      for (int k = 0; k < N; k++){
+         float s, c;
+         SinCosDeg((k*7+p)%720-360, &s, &c);
+         sum += s+c;
+      }
+   Report("SinCosDeg", Timer()-t, &base);
+
+   //  Accuracy against double precision
+   double err = 0;
+   for (int th = -720; th <= 720; th++){
+      float s, c;
+      SinCosDeg(th, &s, &c);
+      err = fmax(err, fabs(s-sin(th*M_PI/180)));
+      err = fmax(err, fabs(c-cos(th*M_PI/180)));
+   }
+   memcpy(fc, fa, 3*N*sizeof(float));
+   Vec3NormalizeArray(fc, N);
+   Vec3CrossArray(fb, fa, fc, N);
+   for (int k = 0; k < N; k++){
+      double v[] = {da[3*k], da[3*k+1], da[3*k+2]}, w[3];
+      Normalize(v);
+      CrossProduct(da+3*k, v, w);
+      for (int i = 0; i < 3; i++)
+         err = fmax(err, fmax(fabs(fc[3*k+i]-v[i]), fabs(fb[3*k+i]-w[i])));
+   }
+   printf("largest difference from double precision %.2g (checksum %g)\n", err, sum);
+
+   //  Transform hierarchy, CHAINS chains of DEPTH nodes
+   int nodes = CHAINS*DEPTH;
+   int* id = (int*)malloc(nodes*sizeof(int));
+   if (!id) Fatal("Cannot allocate transform nodes\n");
+   float L[16];
+   InstanceMatrix(L, NULL, 0.1, 0.2, 0.3, 1, 1.001);
+   for (int c = 0; c < CHAINS; c++)
+      for (int d = 0; d < DEPTH; d++){
+         int k = c*DEPTH+d;
+         id[k] = XformAdd(d ? id[k-1] : -1);
+         XformLocal(id[k], L);
+      }
+   XformUpdate();
+   int nnode, nupdate;
+   //  Every node moved
+   t = Timer();
+   for (int p = 0; p < PASSES; p++){
+      for (int k = 0; k < nodes; k++)
+         XformLocal(id[k], L);
+      XformUpdate();
+   }
+   t = Timer()-t;
+   XformStats(&nnode, &nupdate);
+   printf("%-34s %8.1f M/s  (%d of %d nodes)\n", "XformUpdate every node dirty", 1e-6*nupdate*PASSES/t, nupdate, nnode);
+   //  One node at the root of a chain moved
+   t = Timer();
+   for (int p = 0; p < PASSES; p++){
+      XformLocal(id[0], L);
+      XformUpdate();
+   }
+   t = Timer()-t;
+   XformStats(&nnode, &nupdate);
+   printf("%-34s %8.3f ms per update  (%d of %d nodes)\n", "XformUpdate one chain dirty", 1000*t/PASSES, nupdate, nnode);
+   //  Nothing moved
+   t = Timer();
+   for (int p = 0; p < PASSES; p++)
+      XformUpdate();
+   t = Timer()-t;
+   XformStats(&nnode, &nupdate);
+   printf("%-34s %8.3f ms per update  (%d of %d nodes)\n", "XformUpdate nothing dirty", 1000*t/PASSES, nupdate, nnode);
+   //  The matrix stack XformUpdate replaced: rebuild and read back each world matrix
+   BenchContext(16, 16);
+   float W[16];
+   t = Timer();
+   for (int p = 0; p < PASSES; p++)
+      for (int c = 0; c < CHAINS; c++){
+         glLoadIdentity();
+         for (int d = 0; d < DEPTH; d++){
+            glTranslated(0.1, 0.2, 0.3);
+            glRotated(1, 0, 1, 0);
+            glScaled(1.001, 1.001, 1.001);
+            glGetFloatv(GL_MODELVIEW_MATRIX, W);
+         }
+         sum += W[12];
+      }
+   t = Timer()-t;
+   printf("%-34s %8.1f M/s\n", "glTranslated/glRotated/glScaled", 1e-6*nodes*PASSES/t);
+   printf("world matrix of the last node %g %g %g (checksum %g)\n",
+          XformWorld(id[nodes-1])[12], XformWorld(id[nodes-1])[13], XformWorld(id[nodes-1])[14], sum);
+   return 0;
+}
@@ -0,0 +1,264 @@
+//  CSCIx229 library
+//  Single precision vector, matrix and quaternion math
+#include "CSCIx229.h"
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+//
+//  Vectors are float arrays: vec3 float[3], vec4 float[4], quaternions
+//  float[4] as x,y,z,w, and matrices float[16] column major like OpenGL.
+//  The array routines work on packed x,y,z triples; with SSE they take
+//  four vectors at a time, and every routine has a plain C version.
+//
+//  SinCosDeg serves integer degree angles, the common case in the
+//  geometry generators, from a table instead of calling libm.
+//
+
+static float sinTable[360];  //  Sine of each whole degree
+static int sinReady=0;
+
+//
+//  Sine and cosine of an integer angle in degrees
+//
+void SinCosDeg(int deg,float* s,float* c)
+{
+   if (!sinReady)
+   {
+      for (int k=0;k<360;k++)
+         sinTable[k] = sin(k*M_PI/180);
+      sinReady = 1;
+   }
+   int k = deg%360;
+   if (k<0) k += 360;
+   *s = sinTable[k];
+   *c = sinTable[k<270 ? k+90 : k-270];
+}
+
+//
+//  Dot product
+//
+float Vec3Dot(const float a[3],const float b[3])
+{
+   return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+//
+//  r = a x b (r may be a or b)
+//
+void Vec3Cross(float r[3],const float a[3],const float b[3])
+{
+   float x = a[1]*b[2] - a[2]*b[1];
+   float y = a[2]*b[0] - a[0]*b[2];
+   float z = a[0]*b[1] - a[1]*b[0];
+   r[0] = x;
+   r[1] = y;
+   r[2] = z;
+}
+
+//
+//  Scale v to unit length and return its length
+//    a zero vector is left as it is
+//
+float Vec3Normalize(float v[3])
+{
+   float len = sqrtf(Vec3Dot(v,v));
+   if (len>0)
+   {
+      v[0] /= len;
+      v[1] /= len;
+      v[2] /= len;
+   }
+   return len;
+}
+
+#ifdef __SSE__
+//
+//  Split four packed x,y,z triples into x, y and z vectors
+//
+static void Vec3Load(const float* p,__m128* x,__m128* y,__m128* z)
+{
+   __m128 a = _mm_loadu_ps(p);    //  x0 y0 z0 x1
+   __m128 b = _mm_loadu_ps(p+4);  //  y1 z1 x2 y2
+   __m128 c = _mm_loadu_ps(p+8);  //  z2 x3 y3 z3
+   __m128 xy = _mm_shuffle_ps(b,c,_MM_SHUFFLE(2,1,3,2));  //  x2 y2 x3 y3
+   __m128 yz = _mm_shuffle_ps(a,b,_MM_SHUFFLE(1,0,2,1));  //  y0 z0 y1 z1
+   *x = _mm_shuffle_ps(a,xy,_MM_SHUFFLE(2,0,3,0));
+   *y = _mm_shuffle_ps(yz,xy,_MM_SHUFFLE(3,1,2,0));
+   *z = _mm_shuffle_ps(yz,c,_MM_SHUFFLE(3,0,3,1));
+}
+
+//
+//  Pack x, y and z vectors back into four x,y,z triples
+//
+static void Vec3Store(float* p,__m128 x,__m128 y,__m128 z)
+{
+   __m128 xy01 = _mm_unpacklo_ps(x,y);  //  x0 y0 x1 y1
+   __m128 xy23 = _mm_unpackhi_ps(x,y);  //  x2 y2 x3 y3
+   __m128 zx = _mm_shuffle_ps(z,xy01,_MM_SHUFFLE(2,2,0,0));   //  z0 z0 x1 x1
+   __m128 yz = _mm_shuffle_ps(xy01,z,_MM_SHUFFLE(1,1,3,3));   //  y1 y1 z1 z1
+   __m128 zx2 = _mm_shuffle_ps(z,xy23,_MM_SHUFFLE(2,2,2,2));  //  z2 z2 x3 x3
+   __m128 yz3 = _mm_shuffle_ps(xy23,z,_MM_SHUFFLE(3,3,3,3));  //  y3 y3 z3 z3
+   _mm_storeu_ps(p  ,_mm_shuffle_ps(xy01,zx,_MM_SHUFFLE(2,0,1,0)));
+   _mm_storeu_ps(p+4,_mm_shuffle_ps(yz,xy23,_MM_SHUFFLE(1,0,2,0)));
+   _mm_storeu_ps(p+8,_mm_shuffle_ps(zx2,yz3,_MM_SHUFFLE(2,0,2,0)));
+}
+#endif
+
+//
+//  Normalize n packed x,y,z triples in place
+//
+void Vec3NormalizeArray(float* v,int n)
+{
+   int k=0;
+#ifdef __SSE__
+   __m128 zero = _mm_setzero_ps();
+   __m128 one = _mm_set1_ps(1);
+   for (;k+4<=n;k+=4)
+   {
+      __m128 x,y,z;
+      Vec3Load(v+3*k,&x,&y,&z);
+      __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x,x),_mm_mul_ps(y,y)),_mm_mul_ps(z,z)));
+      //  Zero vectors are divided by one
+      __m128 ok = _mm_cmpgt_ps(len,zero);
+      __m128 d = _mm_or_ps(_mm_and_ps(ok,len),_mm_andnot_ps(ok,one));
+      Vec3Store(v+3*k,_mm_div_ps(x,d),_mm_div_ps(y,d),_mm_div_ps(z,d));
+   }
+#endif
+   for (;k<n;k++)
+      Vec3Normalize(v+3*k);
+}
+
+//
+//  r[k] = a[k] x b[k] for n packed x,y,z triples
+//    r may be a or b
+//
+void Vec3CrossArray(float* r,const float* a,const float* b,int n)
+{
+   int k=0;
+#ifdef __SSE__
+   for (;k+4<=n;k+=4)
+   {
+      __m128 ax,ay,az,bx,by,bz;
+      Vec3Load(a+3*k,&ax,&ay,&az);
+      Vec3Load(b+3*k,&bx,&by,&bz);
+      Vec3Store(r+3*k,_mm_sub_ps(_mm_mul_ps(ay,bz),_mm_mul_ps(az,by)),
+                      _mm_sub_ps(_mm_mul_ps(az,bx),_mm_mul_ps(ax,bz)),
+                      _mm_sub_ps(_mm_mul_ps(ax,by),_mm_mul_ps(ay,bx)));
+   }
+#endif
+   for (;k<n;k++)
+      Vec3Cross(r+3*k,a+3*k,b+3*k);
+}
+
+//
+//  Identity matrix
+//
+void Mat4Identity(float M[16])
+{
+   for (int k=0;k<16;k++)
+      M[k] = (k%5==0);
+}
+
+//
+//  C = A*B (C may be A or B)
+//
+void Mat4Multiply(float C[16],const float A[16],const float B[16])
+{
+#ifdef __SSE__
+   //  Each column of C is the columns of A weighted by a column of B
+   __m128 a0 = _mm_loadu_ps(A);
+   __m128 a1 = _mm_loadu_ps(A+4);
+   __m128 a2 = _mm_loadu_ps(A+8);
+   __m128 a3 = _mm_loadu_ps(A+12);
+   __m128 c[4];
+   for (int j=0;j<4;j++)
+   {
+      c[j] = _mm_mul_ps(a0,_mm_set1_ps(B[4*j]));
+      c[j] = _mm_add_ps(c[j],_mm_mul_ps(a1,_mm_set1_ps(B[4*j+1])));
+      c[j] = _mm_add_ps(c[j],_mm_mul_ps(a2,_mm_set1_ps(B[4*j+2])));
+      c[j] = _mm_add_ps(c[j],_mm_mul_ps(a3,_mm_set1_ps(B[4*j+3])));
+   }
+   for (int j=0;j<4;j++)
+      _mm_storeu_ps(C+4*j,c[j]);
+#else
+   float T[16];
+   for (int j=0;j<4;j++)
+      for (int i=0;i<4;i++)
+         T[4*j+i] = A[i]*B[4*j] + A[4+i]*B[4*j+1] + A[8+i]*B[4*j+2] + A[12+i]*B[4*j+3];
+   memcpy(C,T,sizeof(T));
+#endif
+}
+
+//
+//  r = M*v (r may be v)
+//
+void Mat4Transform(float r[4],const float M[16],const float v[4])
+{
+#ifdef __SSE__
+   __m128 t = _mm_mul_ps(_mm_loadu_ps(M),_mm_set1_ps(v[0]));
+   t = _mm_add_ps(t,_mm_mul_ps(_mm_loadu_ps(M+4),_mm_set1_ps(v[1])));
+   t = _mm_add_ps(t,_mm_mul_ps(_mm_loadu_ps(M+8),_mm_set1_ps(v[2])));
+   t = _mm_add_ps(t,_mm_mul_ps(_mm_loadu_ps(M+12),_mm_set1_ps(v[3])));
+   _mm_storeu_ps(r,t);
+#else
+   float t[4];
+   for (int i=0;i<4;i++)
+      t[i] = M[i]*v[0] + M[4+i]*v[1] + M[8+i]*v[2] + M[12+i]*v[3];
+   memcpy(r,t,sizeof(t));
+#endif
+}
+
+//
+//  Rotation of th degrees about the axis x,y,z
+//
+void QuatAxis(float q[4],float th,float x,float y,float z)
+{
+   float len = sqrtf(x*x+y*y+z*z);
+   float s = len>0 ? sinf(th*M_PI/360)/len : 0;
+   q[0] = s*x;
+   q[1] = s*y;
+   q[2] = s*z;
+   q[3] = cosf(th*M_PI/360);
+}
+
+//
+//  r = a*b, the rotation b followed by a (r may be a or b)
+//
+void QuatMultiply(float r[4],const float a[4],const float b[4])
+{
+   float x = a[3]*b[0] + a[0]*b[3] + a[1]*b[2] - a[2]*b[1];
+   float y = a[3]*b[1] - a[0]*b[2] + a[1]*b[3] + a[2]*b[0];
+   float z = a[3]*b[2] + a[0]*b[1] - a[1]*b[0] + a[2]*b[3];
+   float w = a[3]*b[3] - a[0]*b[0] - a[1]*b[1] - a[2]*b[2];
+   r[0] = x;
+   r[1] = y;
+   r[2] = z;
+   r[3] = w;
+}
+
+//
+//  r = v rotated by unit quaternion q (r may be v)
+//
+void QuatRotate(float r[3],const float q[4],const float v[3])
+{
+   //  v + 2w(q x v) + 2 q x (q x v)
+   float t[3],u[3];
+   Vec3Cross(t,q,v);
+   t[0] *= 2; t[1] *= 2; t[2] *= 2;
+   Vec3Cross(u,q,t);
+   for (int i=0;i<3;i++)
+      r[i] = v[i] + q[3]*t[i] + u[i];
+}
+
+//
+//  Rotation matrix of unit quaternion q
+//
+void Mat4Quat(float M[16],const float q[4])
+{
+   float x=q[0],y=q[1],z=q[2],w=q[3];
+   M[0] = 1-2*(y*y+z*z); M[4] = 2*(x*y-z*w);   M[8]  = 2*(x*z+y*w);   M[12] = 0;
+   M[1] = 2*(x*y+z*w);   M[5] = 1-2*(x*x+z*z); M[9]  = 2*(y*z-x*w);   M[13] = 0;
+   M[2] = 2*(x*z-y*w);   M[6] = 2*(y*z+x*w);   M[10] = 1-2*(x*x+y*y); M[14] = 0;
+   M[3] = 0;             M[7] = 0;             M[11] = 0;             M[15] = 1;
+}
@@ -0,0 +1,95 @@
+//  CSCIx229 library
+//  Transform hierarchy with cached world matrices
+#include "CSCIx229.h"
+
+//
+//  Nodes live in flat arrays indexed by node number: parent, local
+//  matrix, world matrix and a dirty flag.  Parents are added before
+//  their children, so one pass in node order sees every parent's world
+//  matrix before its children need it.  XformUpdate only multiplies
+//  nodes whose local matrix changed or whose parent was updated in the
+//  same pass, so a still hierarchy costs a scan of the flags.  The
+//  products use the SSE Mat4Multiply.  Matrices are column major like
+//  OpenGL's.
+//
+
+static int* parent=NULL;           //  Parent node (-1 for a root)
+static float (*local)[16]=NULL;    //  Local matrices
+static float (*world)[16]=NULL;    //  World matrices
+static unsigned char* dirty=NULL;  //  Local matrix changed
+static unsigned char* moved=NULL;  //  World matrix updated in this pass
+static int N=0,Max=0;              //  Node count and capacity
+static int updates=0;              //  Matrix products in the last update
+
+//
+//  Add a node under parent (-1 for a root) with an identity local matrix
+//
+int XformAdd(int p)
+{
+   if (p>=N) Fatal("Transform parent %d must be added before its children\n",p);
+   if (N>=Max)
+   {
+      Max = Max ? 2*Max : 256;
+      parent = (int*)realloc(parent,Max*sizeof(int));
+      local  = (float(*)[16])realloc(local,Max*sizeof(*local));
+      world  = (float(*)[16])realloc(world,Max*sizeof(*world));
+      dirty  = (unsigned char*)realloc(dirty,Max);
+      moved  = (unsigned char*)realloc(moved,Max);
+      if (!parent || !local || !world || !dirty || !moved) Fatal("Cannot allocate %d transform nodes\n",Max);
+   }
+   const float I[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1};
+   parent[N] = p;
+   memcpy(local[N],I,sizeof(I));
+   memcpy(world[N],I,sizeof(I));
+   dirty[N] = 1;
+   moved[N] = 0;
+   return N++;
+}
+
+//
+//  Set the local matrix of a node
+//
+void XformLocal(int id,const float M[16])
+{
+   if (id<0 || id>=N) Fatal("Invalid transform node %d\n",id);
+   memcpy(local[id],M,sizeof(local[id]));
+   dirty[id] = 1;
+}
+
+//
+//  Bring the world matrices of changed nodes and their descendants up to date
+//
+void XformUpdate(void)
+{
+   updates = 0;
+   for (int k=0;k<N;k++)
+   {
+      int p = parent[k];
+      moved[k] = dirty[k] || (p>=0 && moved[p]);
+      if (!moved[k]) continue;
+      if (p<0)
+         memcpy(world[k],local[k],sizeof(world[k]));
+      else
+         Mat4Multiply(world[k],world[p],local[k]);
+      dirty[k] = 0;
+      updates++;
+   }
+}
+
+//
+//  Return the world matrix of a node as of the last XformUpdate
+//
+const float* XformWorld(int id)
+{
+   if (id<0 || id>=N) Fatal("Invalid transform node %d\n",id);
+   return world[id];
+}
+
+//
+//  Return the nodes and the world matrices updated by the last XformUpdate
+//
+void XformStats(int* nnode,int* nupdate)
+{
+   *nnode   = N;
+   *nupdate = updates;
+}